@@ -0,0 +1,63 @@
+#pragma once
+
+#include "ofxCore.h"
+
+
+////////////////////////////////////////////////////////////////////////////////
+// The debanding engine, without a host.  Everything in the DebandCore
+// library -- the kernels, the tables that pick them, the cost profiles --
+// sees only this: caller-owned pixels as pointer, row stride and rect
+// (KernelArgs in KernelTable.h), and a DebandHost to run on.  From the OFX
+// SDK it needs only the plain types in ofxCore.h and ofxPixels.h.
+//
+// The plugin and debandpipe are both adapters over it; so can anything
+// else be that has frames in memory.
+
+// how band pixels get their new colors
+enum DebandMode {
+	kModeRamps = 0,		// 1-D ramps along rows, then columns
+	kModeDistance = 1	// 2-D ramps from distances to the band's contours
+};
+
+// what the output shows instead of the debanded picture
+enum DebandDiagnostic {
+	kDiagOff = 0,
+	kDiagBandLength = 1,	// longer of each pixel's row and column band, log scale
+	kDiagCost = 2,			// time spent per pixel by the threads that rendered it
+	kDiagCopied = 3			// green where interpolated, dimmed source where copied
+};
+
+// which ramps the ramps mode runs
+enum DebandDirection {
+	kDirBoth = 0,		// rows, then columns averaged in
+	kDirRows = 1,
+	kDirColumns = 2
+};
+
+// Bit depths are 8, 16, 32 (float) or this, as ofxUtilities' ofxuMapPixelDepth.
+const int kBitDepthHalf = -16;
+
+// one of the threads a pass runs on, i of n; the same shape as OFX's
+// OfxThreadFunctionV1, so a host's thread suite can run it as it is
+typedef void (*DebandTask)(unsigned int i, unsigned int n, void *arg);
+
+// What the engine needs from whoever runs it.  Several renders may share
+// one at once, so none of it may change while they run.
+struct DebandHost {
+	// Run task(i, threads, arg) for every i below threads, at once, and
+	// return when all have.  0 runs them one after another on this thread.
+	void (*parallel)(DebandTask task, unsigned int threads, void *arg, void *user);
+	unsigned int threads;	// threads per pass; 0 is 1
+	int stripWidth;			// widest chunk of a column pass; 0 is no limit
+
+	// Whether the caller has given up on the render; checked every few
+	// rows, and nothing more is written once it says so.  0 never gives up.
+	bool (*cancelled)(void *user);
+
+	void *user;				// handed back to parallel and cancelled
+};
+
+inline bool debandCancelled(const DebandHost *host)
+{
+	return host->cancelled && host->cancelled(host->user);
+}
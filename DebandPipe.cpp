@@ -0,0 +1,982 @@
+// debandpipe: run the debanding kernels as a filter between a decoder and
+// an encoder, without a compositing host: just the DebandCore library.
+//
+//   ffmpeg -i in.mov -f yuv4mpegpipe - | debandpipe | x264 --demuxer y4m -o out.mkv -
+//   ... | debandpipe --raw 3840x2160 --format rgbaf | ...
+//
+// y4m planes are debanded one at a time as single-channel images, so any
+// chroma layout and 8 to 16 bit samples work.  Raw input is packed RGBA
+// or RGB, and may be written out deeper than it came in.
+//
+// One reader thread fills a fixed ring of frame slots, a pool of workers
+// deband whichever slots are full, and the main thread writes them back
+// out strictly in order.  The ring bounds how many frames are in flight;
+// all the frame memory is allocated up front.
+//
+// --verify writes no frames: it runs the kernel --mode and --luma pick on
+// each one in every thread count and strip width, with and without a
+// mask, and in each KernelVariant that applies, checks the output against
+// the reference kernel (Reference.h) and prints how far off and how much
+// faster each was, and checks the distance transform against brute force.  --synthetic makes up banded
+// frames to feed it, and stills can be piped in as raw frames:
+//
+//   ffmpeg -i still.png -f rawvideo -pix_fmt rgba - | debandpipe --raw 1920x1080 --verify
+
+#include "DebandCore.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <memory>
+#include <atomic>
+#include <deque>
+#include <algorithm>
+#include <random>
+#include <cmath>
+#include <new>
+#include "KernelTable.h"
+#include "Reference.h"
+#include "Half.h"
+#include "Metrics.h"
+#include "FrameBudget.h"
+#include "DistanceTransform.h"
+
+#ifdef _WIN32
+#  include <io.h>
+#  include <fcntl.h>
+#endif
+
+
+// ===================================================== //
+// Allocations are counted per worker, by every thread working for it, to
+// show that frames allocate nothing once the first few have grown the
+// worker's scratch.  Threads that work for no one count nothing.
+
+static thread_local std::atomic<long long> *allocations;
+
+void *operator new(size_t size)
+{
+	if (allocations)
+		count(*allocations);
+	void *p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { operator delete(p); }
+void operator delete(void *p, size_t) noexcept { operator delete(p); }
+void operator delete[](void *p, size_t) noexcept { operator delete(p); }
+
+
+// ===================================================== //
+// The engine runs on our own threads.  Errors exit the whole process, so a
+// render never needs cancelling.
+//
+// Each worker has a team for its frames' passes, started once: the
+// worker's thread is thread 0, and the rest sleep until a pass wakes them,
+// so running one starts no threads.
+
+class ThreadTeam {
+public:
+	// helpers besides the caller's thread; each counts into allocations
+	ThreadTeam(unsigned helpers, std::atomic<long long> *allocations);
+	~ThreadTeam();
+
+	// Run task(i, n, arg) for every i below n, 0 on this thread and the
+	// rest on helpers.  Any the team is too small for run here after 0.
+	void run(DebandTask task, unsigned n, void *arg);
+
+private:
+	std::vector<std::thread> threads;
+	std::mutex lock;
+	std::condition_variable wake, done;
+	DebandTask task;
+	void *arg;
+	unsigned n;
+	long long generation;	// runs started, so helpers can tell a new one
+	unsigned working;		// helpers not done with this run yet
+	bool quit;
+
+	void helper(unsigned i, std::atomic<long long> *counter);
+};
+
+ThreadTeam::ThreadTeam(unsigned helpers, std::atomic<long long> *counter)
+	: task(0), arg(0), n(0), generation(0), working(0), quit(false)
+{
+	for (unsigned i = 1; i <= helpers; i++)
+		threads.emplace_back(&ThreadTeam::helper, this, i, counter);
+}
+
+ThreadTeam::~ThreadTeam()
+{
+	{
+		std::lock_guard<std::mutex> l(lock);
+		quit = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+}
+
+void ThreadTeam::run(DebandTask t, unsigned nThreads, void *a)
+{
+	if (nThreads == 0)
+		return;
+
+	unsigned helpers = Minimum(nThreads - 1, (unsigned)threads.size());
+	{
+		std::lock_guard<std::mutex> l(lock);
+		task = t;
+		arg = a;
+		n = nThreads;
+		working = helpers;
+		generation++;
+	}
+	if (helpers)
+		wake.notify_all();
+
+	t(0, nThreads, a);
+	for (unsigned i = helpers + 1; i < nThreads; i++)
+		t(i, nThreads, a);
+
+	std::unique_lock<std::mutex> l(lock);
+	done.wait(l, [&] { return working == 0; });
+}
+
+void ThreadTeam::helper(unsigned i, std::atomic<long long> *counter)
+{
+	allocations = counter;
+	long long seen = 0;
+	std::unique_lock<std::mutex> l(lock);
+	for (;;) {
+		wake.wait(l, [&] { return quit || generation != seen; });
+		if (quit)
+			return;
+		seen = generation;
+		if (i >= n)
+			continue;
+
+		DebandTask t = task;
+		void *a = arg;
+		unsigned nThreads = n;
+		l.unlock();
+		t(i, nThreads, a);
+		l.lock();
+		if (--working == 0)
+			done.notify_one();
+	}
+}
+
+static void teamParallel(DebandTask task, unsigned int nThreads, void *arg, void *user)
+{
+	((ThreadTeam *)user)->run(task, nThreads, arg);
+}
+
+// frames each worker renders before its scratch counts as grown
+const long long kWarmupFrames = 2;
+
+// what one worker renders with: its team, and the scratch its frames work in
+struct Worker {
+	std::atomic<long long> allocations;	// by the worker's threads, ever
+	long long frames;
+	ThreadTeam team;
+	DebandHost host;
+	Scratch scratch;
+
+	explicit Worker(unsigned threads)
+		: allocations(0), frames(0), team(threads - 1, &allocations)
+	{
+		DebandHost h = { teamParallel, threads, 0, 0, &team };
+		host = h;
+	}
+};
+
+
+// ===================================================== //
+// stream layout
+
+// one image in a frame: a y4m plane, or the whole raw RGB(A) frame
+struct Plane {
+	size_t offset;
+	int width, height;
+	int bitDepth;		// 8, 16, 32 or kBitDepthHalf
+	int pixelBytes;
+	int components;		// 1 for a y4m plane, 3 or 4 raw
+
+	// where and how it goes in the output frame; the same unless promoted
+	size_t dstOffset;
+	int dstBitDepth;
+	int dstPixelBytes;
+};
+
+struct Stream {
+	bool y4m;
+	char header[1024];	// y4m stream header, passed through as is
+	std::vector<Plane> planes;
+	size_t frameBytes, dstFrameBytes;
+};
+
+static void fail(const char *msg, const char *arg = "")
+{
+	fprintf(stderr, "debandpipe: %s%s\n", msg, arg);
+	exit(1);
+}
+
+// read one '\n'-terminated line, keeping the newline
+static bool readLine(FILE *in, char *buf, size_t size)
+{
+	size_t n = 0;
+	int c;
+	while ((c = getc(in)) != EOF) {
+		if (n + 2 >= size)
+			fail("header line too long");
+		buf[n++] = (char)c;
+		if (c == '\n')
+			break;
+	}
+	buf[n] = 0;
+	return n > 0;
+}
+
+static void addPlane(Stream &s, int width, int height, int sampleBytes)
+{
+	Plane p;
+	p.offset = s.frameBytes;
+	p.width = width;
+	p.height = height;
+	p.bitDepth = sampleBytes == 1 ? 8 : 16;
+	p.pixelBytes = sampleBytes;
+	p.components = 1;
+	p.dstOffset = p.offset;
+	p.dstBitDepth = p.bitDepth;
+	p.dstPixelBytes = p.pixelBytes;
+	s.planes.push_back(p);
+	s.frameBytes += (size_t)width * height * sampleBytes;
+	s.dstFrameBytes = s.frameBytes;
+}
+
+// Parse "YUV4MPEG2 W1920 H1080 F25:1 Ip A1:1 C420jpeg" and lay out the planes.
+static void parseY4mHeader(FILE *in, Stream &s)
+{
+	if (!readLine(in, s.header, sizeof(s.header)) || strncmp(s.header, "YUV4MPEG2 ", 10) != 0)
+		fail("input is not y4m; use --raw for raw frames");
+
+	char line[sizeof(s.header)];
+	strcpy(line, s.header);
+
+	int w = 0, h = 0;
+	char colour[32] = "420jpeg";
+	for (char *tok = strtok(line + 10, " \n"); tok; tok = strtok(0, " \n")) {
+		if (tok[0] == 'W') w = atoi(tok + 1);
+		else if (tok[0] == 'H') h = atoi(tok + 1);
+		else if (tok[0] == 'C') { strncpy(colour, tok + 1, sizeof(colour) - 1); colour[sizeof(colour) - 1] = 0; }
+	}
+	if (w <= 0 || h <= 0)
+		fail("y4m header has no size");
+
+	// "p10", "p16" etc. mean 16-bit little-endian samples
+	const char *deep = strchr(colour, 'p');
+	int sampleBytes = (deep && atoi(deep + 1) > 8) || strcmp(colour, "mono16") == 0 ? 2 : 1;
+
+	int cw = w, ch = h, nChroma = 2;
+	if (strncmp(colour, "420", 3) == 0) { cw = (w + 1) / 2; ch = (h + 1) / 2; }
+	else if (strncmp(colour, "422", 3) == 0) { cw = (w + 1) / 2; }
+	else if (strncmp(colour, "411", 3) == 0) { cw = (w + 3) / 4; }
+	else if (strncmp(colour, "444", 3) == 0) { }
+	else if (strncmp(colour, "mono", 4) == 0) { nChroma = 0; }
+	else fail("unsupported y4m colorspace C", colour);
+
+	s.frameBytes = 0;
+	addPlane(s, w, h, sampleBytes);
+	for (int i = 0; i < nChroma; i++)
+		addPlane(s, cw, ch, sampleBytes);
+	if (strcmp(colour, "444alpha") == 0)
+		addPlane(s, w, h, sampleBytes);
+}
+
+// "rgba8", "rgbf" etc.
+static void parseFormat(const char *option, const char *format, int &components, int &bitDepth, int &pixelBytes)
+{
+	if (strncmp(format, "rgb", 3) != 0)
+		fail(option, format);
+	components = format[3] == 'a' ? 4 : 3;
+	const char *depth = format + components;
+	if (strcmp(depth, "8") == 0) { bitDepth = 8; pixelBytes = components; }
+	else if (strcmp(depth, "16") == 0) { bitDepth = 16; pixelBytes = 2 * components; }
+	else if (strcmp(depth, "h") == 0) { bitDepth = kBitDepthHalf; pixelBytes = 2 * components; }
+	else if (strcmp(depth, "f") == 0) { bitDepth = 32; pixelBytes = 4 * components; }
+	else fail(option, format);
+}
+
+// outFormat may be 0 for the same as format
+static void setupRaw(Stream &s, const char *size, const char *format, const char *outFormat)
+{
+	int w = 0, h = 0;
+	if (sscanf(size, "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0)
+		fail("bad --raw size ", size);
+
+	Plane p;
+	p.offset = 0;
+	p.width = w;
+	p.height = h;
+	parseFormat("unknown --format ", format, p.components, p.bitDepth, p.pixelBytes);
+
+	p.dstOffset = 0;
+	p.dstBitDepth = p.bitDepth;
+	p.dstPixelBytes = p.pixelBytes;
+	if (outFormat) {
+		int components;
+		parseFormat("unknown --out-format ", outFormat, components, p.dstBitDepth, p.dstPixelBytes);
+		if (components != p.components || !findKernel(p.bitDepth, p.dstBitDepth, components, kDirBoth, false, false, false))
+			fail("can't write --format as --out-format ", outFormat);
+	}
+
+	s.y4m = false;
+	s.header[0] = 0;
+	s.planes.push_back(p);
+	s.frameBytes = (size_t)w * h * p.pixelBytes;
+	s.dstFrameBytes = (size_t)w * h * p.dstPixelBytes;
+}
+
+
+// ===================================================== //
+// --synthetic: made-up frames instead of input
+
+// one sample, v 0..1
+static void setSample(unsigned char *p, int bitDepth, float v)
+{
+	v = v < 0 ? 0 : v > 1 ? 1 : v;
+	if (bitDepth == 8) *p = (unsigned char)lrintf(v * 255);
+	else if (bitDepth == 16) *(unsigned short *)p = (unsigned short)lrintf(v * 65535);
+	else if (bitDepth == kBitDepthHalf) *(Half *)p = v;
+	else *(float *)p = v;
+}
+
+// Frame seq: a gradient quantized into bands, square to the frame (so
+// there are duplicate rows or columns) or at a random angle, with a few
+// flat blocks for edges and specks of noise.  Float and half frames also
+// get a block of zeros whose sign flips pixel to pixel, which is still one
+// band.  Even frames sit on an 8 bit grid, odd ones on a 10 bit one.  The
+// same seq always makes the same frame.
+static void syntheticFrame(const Stream &s, long long seq, unsigned char *frame)
+{
+	std::mt19937 rng((unsigned)seq + 1);
+	std::uniform_real_distribution<float> u(0.f, 1.f);
+	float levels = seq % 2 ? 1023.f : 255.f;
+
+	for (size_t i = 0; i < s.planes.size(); i++) {
+		const Plane &pl = s.planes[i];
+		int sampleBytes = pl.pixelBytes / pl.components;
+		bool signedZeros = pl.bitDepth == 32 || pl.bitDepth == kBitDepthHalf;
+		OfxRectI zeros = { pl.width / 8, pl.height / 2, pl.width / 8 + pl.width / 4, pl.height / 2 + pl.height / 4 };
+
+		float angle = seq % 3 == 0 ? 0.f : seq % 3 == 1 ? 1.5707964f : u(rng) * 6.2831855f;
+		float dx = std::cos(angle) / pl.width, dy = std::sin(angle) / pl.height;
+		float base[4], span[4];
+		for (int k = 0; k < pl.components; k++) {
+			base[k] = 0.1f + 0.6f * u(rng);
+			span[k] = 0.02f + 0.2f * u(rng);
+		}
+
+		OfxRectI blocks[4];
+		float blockValue[4];
+		int nBlocks = (int)(u(rng) * 5) % 5;
+		for (int b = 0; b < nBlocks; b++) {
+			blocks[b].x1 = (int)(u(rng) * pl.width);
+			blocks[b].y1 = (int)(u(rng) * pl.height);
+			blocks[b].x2 = blocks[b].x1 + 1 + (int)(u(rng) * pl.width / 3);
+			blocks[b].y2 = blocks[b].y1 + 1 + (int)(u(rng) * pl.height / 3);
+			blockValue[b] = u(rng);
+		}
+
+		for (int y = 0; y < pl.height; y++)
+			for (int x = 0; x < pl.width; x++) {
+				int block = -1;
+				for (int b = 0; b < nBlocks; b++)
+					if (x >= blocks[b].x1 && x < blocks[b].x2 && y >= blocks[b].y1 && y < blocks[b].y2)
+						block = b;
+				bool speck = u(rng) < 0.001f;
+
+				unsigned char *p = frame + pl.offset + ((size_t)y * pl.width + x) * pl.pixelBytes;
+				for (int k = 0; k < pl.components; k++) {
+					float v = block >= 0 ? blockValue[block] + 0.05f * k : base[k] + span[k] * (x * dx + y * dy);
+					if (speck)
+						v = u(rng);
+					v = std::floor(v * levels + 0.5f) / levels;
+					if (signedZeros && x >= zeros.x1 && x < zeros.x2 && y >= zeros.y1 && y < zeros.y2)
+						v = (x + y) % 2 ? -0.f : 0.f;
+					setSample(p + k * sampleBytes, pl.bitDepth, v);
+				}
+			}
+	}
+}
+
+
+// ===================================================== //
+// the pipeline
+
+enum SlotState { kSlotFree, kSlotFilled, kSlotWorking, kSlotDone };
+
+struct Slot {
+	SlotState state;
+	long long seq;
+	char frameHeader[256];	// y4m "FRAME ..." line
+	std::vector<unsigned char> src, dst;
+};
+
+struct Pipeline {
+	Stream stream;
+	FILE *in, *out;
+	int mode, direction;
+	bool dither, keepEdges, luma;
+	Quantization quant;			// float input's grid, kept from frame to frame
+	double budget;				// seconds per frame, or 0 for no limit
+	std::unique_ptr<FrameBudget[]> budgets;	// one per plane
+	std::atomic<long long> degradedFrames;
+	std::atomic<long long> warmAllocations;	// in frames after each worker's warm-up
+
+	std::vector<Slot> slots;
+	std::mutex lock;
+	std::condition_variable changed;
+	long long nextWork;			// next frame a worker should pick up
+	long long frameCount;		// known once the reader hits EOF, -1 till then
+	long long synthetic;		// frames to make up instead of reading, or 0
+};
+
+// Fill slot's src with frame seq, read from the input or made up.  False
+// at the end of the input.
+static bool readFrame(Pipeline *p, long long seq, Slot &slot)
+{
+	if (p->synthetic > 0) {
+		if (seq >= p->synthetic)
+			return false;
+		syntheticFrame(p->stream, seq, &slot.src[0]);
+		return true;
+	}
+
+	bool ok;
+	if (p->stream.y4m) {
+		ok = readLine(p->in, slot.frameHeader, sizeof(slot.frameHeader));
+		if (ok && strncmp(slot.frameHeader, "FRAME", 5) != 0)
+			fail("bad y4m frame header");
+	}
+	else
+		ok = true;
+	size_t got = ok ? fread(&slot.src[0], 1, p->stream.frameBytes, p->in) : 0;
+	if (got == 0 && (!p->stream.y4m || !ok))
+		return false;
+	if (got != p->stream.frameBytes)
+		fail("truncated frame at end of input");
+	return true;
+}
+
+static void reader(Pipeline *p)
+{
+	for (long long seq = 0; ; seq++) {
+		Slot &slot = p->slots[seq % p->slots.size()];
+		{
+			std::unique_lock<std::mutex> l(p->lock);
+			p->changed.wait(l, [&] { return slot.state == kSlotFree; });
+		}
+
+		if (!readFrame(p, seq, slot)) {
+			std::lock_guard<std::mutex> l(p->lock);
+			p->frameCount = seq;
+			p->changed.notify_all();
+			return;
+		}
+
+		std::lock_guard<std::mutex> l(p->lock);
+		slot.seq = seq;
+		slot.state = kSlotFilled;
+		p->changed.notify_all();
+	}
+}
+
+static void debandFrame(Pipeline *p, Slot &slot, Worker &w)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	long long allocated = w.allocations;
+	bool degraded = false;
+	for (size_t i = 0; i < p->stream.planes.size(); i++) {
+		const Plane &pl = p->stream.planes[i];
+		KernelFn kernel = findKernel(pl.bitDepth, pl.dstBitDepth, pl.components, p->direction, false, p->dither, p->luma);
+		OfxRectI rect = { 0, 0, pl.width, pl.height };
+		KernelArgs args = { &w.host,
+			&slot.src[pl.offset], rect, pl.width * pl.pixelBytes,
+			&slot.dst[pl.dstOffset], rect, pl.width * pl.dstPixelBytes,
+			0, rect, 0,
+			rect, p->mode, p->keepEdges, 0, 0, &p->quant, &w.scratch };
+
+		// each plane gets its share of the frame's budget by size
+		long long pixels = (long long)pl.width * pl.height;
+		if (p->budget > 0 && !(p->mode == kModeRamps && p->direction == kDirRows)) {
+			KernelFn rows = findKernel(pl.bitDepth, pl.dstBitDepth, pl.components, kDirRows, false, p->dither, p->luma);
+			double share = p->budget * pixels * pl.pixelBytes / p->stream.frameBytes;
+			degraded |= p->budgets[i].render(kernel, rows, args, share);
+		}
+		else
+			kernel(args);
+
+		count(metrics.pixels, pixels);
+		count(metrics.bytesRead, pixels * pl.pixelBytes);
+		count(metrics.bytesWritten, pixels * pl.dstPixelBytes);
+	}
+	if (degraded) {
+		p->degradedFrames++;
+		fprintf(stderr, "debandpipe: frame %lld rows only to meet the budget\n", slot.seq);
+	}
+	count(metrics.renders);
+	count(metrics.renderMicroseconds, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+
+	if (++w.frames > kWarmupFrames)
+		p->warmAllocations += w.allocations - allocated;
+}
+
+static void worker(Pipeline *p, Worker *w)
+{
+	allocations = &w->allocations;
+	for (;;) {
+		Slot *slot;
+		{
+			std::unique_lock<std::mutex> l(p->lock);
+			p->changed.wait(l, [&] {
+				Slot &s = p->slots[p->nextWork % p->slots.size()];
+				return (p->frameCount >= 0 && p->nextWork >= p->frameCount)
+					|| (s.state == kSlotFilled && s.seq == p->nextWork);
+			});
+			if (p->frameCount >= 0 && p->nextWork >= p->frameCount)
+				return;
+			slot = &p->slots[p->nextWork % p->slots.size()];
+			slot->state = kSlotWorking;
+			p->nextWork++;
+		}
+
+		debandFrame(p, *slot, *w);
+
+		std::lock_guard<std::mutex> l(p->lock);
+		slot->state = kSlotDone;
+		p->changed.notify_all();
+	}
+}
+
+// writes frames strictly in order; returns the number written
+static long long writer(Pipeline *p)
+{
+	if (p->stream.y4m && fputs(p->stream.header, p->out) == EOF)
+		fail("write error");
+
+	long long seq;
+	for (seq = 0; ; seq++) {
+		Slot &slot = p->slots[seq % p->slots.size()];
+		{
+			std::unique_lock<std::mutex> l(p->lock);
+			p->changed.wait(l, [&] {
+				return (slot.state == kSlotDone && slot.seq == seq)
+					|| (p->frameCount >= 0 && seq >= p->frameCount);
+			});
+			if (slot.state != kSlotDone || slot.seq != seq)
+				break;
+		}
+
+		if ((p->stream.y4m && fputs(slot.frameHeader, p->out) == EOF)
+			|| fwrite(&slot.dst[0], 1, p->stream.dstFrameBytes, p->out) != p->stream.dstFrameBytes)
+			fail("write error");
+
+		std::lock_guard<std::mutex> l(p->lock);
+		slot.state = kSlotFree;
+		p->changed.notify_all();
+	}
+	fflush(p->out);
+	return seq;
+}
+
+
+// ===================================================== //
+// --verify
+
+// one way of running the kernel, or the reference if threads is 0
+struct VerifyRun {
+	unsigned threads;
+	int stripWidth;
+	bool masked;
+	int variants;			// KernelVariant bits
+	Quantization quant;		// kept from frame to frame, as an instance's is
+	double seconds;
+	double maxError;		// output codes, or values for float and half
+	long long differing;	// samples
+
+	VerifyRun(unsigned threads, int stripWidth, bool masked, int variants)
+		: threads(threads), stripWidth(stripWidth), masked(masked), variants(variants), seconds(0), maxError(0), differing(0) {}
+};
+
+// sample i of an image, in codes for integers
+static double sampleAt(const unsigned char *p, size_t i, int bitDepth)
+{
+	switch (bitDepth) {
+	case 8: return p[i];
+	case 16: return ((const unsigned short *)p)[i];
+	case kBitDepthHalf: return (float)((const Half *)p)[i];
+	default: return ((const float *)p)[i];
+	}
+}
+
+// Both passes of the transform over a w x h image of flags, as the
+// distance kernels run them a slice at a time.  nearest[i] gets the index
+// y * w + x of the seed nearest pixel i, or -1 if there are none, and
+// d2[i] the squared distance to it.  Of seeds equally near, it's the
+// leftmost, then the upper one.  Works in scratch.
+static void distanceTransform2D(const unsigned char *flags, int w, int h,
+	unsigned char mask, unsigned char want, int *nearest, double *d2, ScratchArena &scratch)
+{
+	if (w <= 0 || h <= 0)
+		return;
+
+	scratch.reset();
+	int *seedRow = scratch.take<int>((size_t)w * h), *last = scratch.take<int>(w);
+	int *near = scratch.take<int>(w), *v = scratch.take<int>(w);
+	double *f = scratch.take<double>(w), *z = scratch.take<double>(w + 1);
+	nearestSeedColumns(flags, w, h, w, mask, want, seedRow, last);
+
+	for (int y = 0; y < h; y++)
+	{
+		const int *s = &seedRow[(size_t)y * w];
+		for (int x = 0; x < w; x++)
+			f[x] = s[x] < 0 ? kDistInfinity : (double)(y - s[x]) * (y - s[x]);
+		distanceTransform1D(f, w, near, &d2[(size_t)y * w], v, z);
+		for (int x = 0; x < w; x++)
+			nearest[(size_t)y * w + x] = near[x] < 0 ? -1 : s[near[x]] * w + near[x];
+	}
+}
+
+// Checks the distance transform against brute force on the top left of
+// a plane, at most kEdtSize square: seeds are samples that differ from a
+// neighbour, and the low bit of the first byte splits them in two, as
+// band classes split contours.  Returns how many pixels' nearest seed or
+// distance came out differently.
+const int kEdtSize = 64;
+
+static long long checkDistanceTransform(const unsigned char *src, const Plane &pl)
+{
+	int w = Minimum(pl.width, kEdtSize), h = Minimum(pl.height, kEdtSize);
+	std::vector<unsigned char> flags((size_t)w * h);
+	for (int y = 0; y < h; y++)
+		for (int x = 0; x < w; x++) {
+			const unsigned char *p = &src[((size_t)y * pl.width + x) * pl.pixelBytes];
+			bool edge = false;
+			if (x > 0) edge |= memcmp(p, p - pl.pixelBytes, pl.pixelBytes) != 0;
+			if (x + 1 < w) edge |= memcmp(p, p + pl.pixelBytes, pl.pixelBytes) != 0;
+			if (y > 0) edge |= memcmp(p, p - (size_t)pl.width * pl.pixelBytes, pl.pixelBytes) != 0;
+			if (y + 1 < h) edge |= memcmp(p, p + (size_t)pl.width * pl.pixelBytes, pl.pixelBytes) != 0;
+			flags[(size_t)y * w + x] = (unsigned char)((edge ? 1 : 0) | (p[0] & 1) << 1);
+		}
+
+	long long wrong = 0;
+	std::vector<int> nearest(flags.size());
+	std::vector<double> d2(flags.size());
+	ScratchArena scratch;
+	for (unsigned char want = 1; want <= 3; want += 2) {
+		distanceTransform2D(&flags[0], w, h, 3, want, &nearest[0], &d2[0], scratch);
+
+		// seeds left to right, then top to bottom, so the first nearest
+		// is the one the transform should pick
+		std::vector<int> seeds;
+		for (int x = 0; x < w; x++)
+			for (int y = 0; y < h; y++)
+				if ((flags[(size_t)y * w + x] & 3) == want)
+					seeds.push_back(y * w + x);
+
+		for (int i = 0; i < w * h; i++) {
+			int best = -1;
+			double bestD2 = 0;
+			for (int s : seeds) {
+				double dx = s % w - i % w, dy = s / w - i / w;
+				if (best < 0 || dx * dx + dy * dy < bestD2) {
+					best = s;
+					bestD2 = dx * dx + dy * dy;
+				}
+			}
+			if (nearest[i] != best || (best >= 0 && d2[i] != bestD2))
+				wrong++;
+		}
+	}
+	return wrong;
+}
+
+// Runs every frame through each VerifyRun and prints the table; returns
+// the exit status.
+static int verify(Pipeline *p)
+{
+	// 17 is narrow and odd, to put strip edges everywhere
+	std::vector<unsigned> threadCounts = { 1, 2, 4 };
+	unsigned cores = std::thread::hardware_concurrency();
+	if (cores > 4)
+		threadCounts.push_back(cores);
+	const int stripWidths[] = { 0, 17, 256 };
+
+	// every kernel findKernel might pick for these frames: half converting
+	// with F16C and without, float on a grid comparing bits and floats
+	const std::vector<Plane> &planes = p->stream.planes;
+	std::vector<int> variants(1, 0);
+	if (planes[0].bitDepth == kBitDepthHalf && halfHasF16C())
+		variants.push_back(kSoftHalf);
+	if (planes[0].bitDepth == 32 && !p->luma)
+		variants.push_back(kUnkeyedFloat);
+
+	std::deque<VerifyRun> runs;
+	for (int masked = 0; masked < 2; masked++) {
+		runs.emplace_back(0, 0, masked != 0, 0);
+		for (int v : variants)
+			for (size_t t = 0; t < threadCounts.size(); t++)
+				for (int s : stripWidths)
+					runs.emplace_back(threadCounts[t], s, masked != 0, v);
+	}
+
+	// each plane's mask ramps up across it, flat at either end
+	std::vector<std::vector<unsigned char> > masks(planes.size());
+	for (size_t i = 0; i < planes.size(); i++) {
+		const Plane &pl = planes[i];
+		int sampleBytes = pl.pixelBytes / pl.components;
+		masks[i].resize((size_t)pl.width * pl.height * sampleBytes);
+		for (int y = 0; y < pl.height; y++)
+			for (int x = 0; x < pl.width; x++)
+				setSample(&masks[i][((size_t)y * pl.width + x) * sampleBytes], pl.bitDepth, 1.5f * x / pl.width - 0.25f);
+	}
+
+	// one team big enough for every run, and one scratch, as a worker has
+	ThreadTeam team(*std::max_element(threadCounts.begin(), threadCounts.end()) - 1, 0);
+	Scratch scratch;
+
+	Slot &slot = p->slots[0];
+	std::vector<unsigned char> expected(p->stream.dstFrameBytes);
+	long long frames, edtWrong = 0;
+	for (frames = 0; readFrame(p, frames, slot); frames++) {
+		for (size_t i = 0; i < planes.size(); i++) {
+			const Plane &pl = planes[i];
+			edtWrong += checkDistanceTransform(&slot.src[pl.offset], pl);
+			OfxRectI rect = { 0, 0, pl.width, pl.height };
+			size_t samples = (size_t)pl.width * pl.height * pl.components;
+			size_t dstBytes = (size_t)pl.width * pl.height * pl.dstPixelBytes;
+
+			// in order, so each reference is in expected before the runs checked against it
+			for (size_t r = 0; r < runs.size(); r++) {
+				VerifyRun &run = runs[r];
+				DebandHost runHost = { teamParallel, run.threads, run.stripWidth, 0, &team };
+				unsigned char *out = run.threads ? &slot.dst[pl.dstOffset] : &expected[pl.dstOffset];
+				KernelFn kernel = run.threads
+					? findKernel(pl.bitDepth, pl.dstBitDepth, pl.components, p->direction, run.masked, p->dither, p->luma, run.variants)
+					: findReferenceKernel(pl.bitDepth, pl.dstBitDepth, pl.components, p->direction, p->dither, p->luma);
+				KernelArgs args = { &runHost,
+					&slot.src[pl.offset], rect, pl.width * pl.pixelBytes,
+					out, rect, pl.width * pl.dstPixelBytes,
+					run.masked ? &masks[i][0] : 0, rect, pl.width * pl.pixelBytes / pl.components,
+					rect, p->mode, p->keepEdges, 0, 0, &run.quant, &scratch };
+
+				// anything the kernel doesn't write shows up
+				memset(out, 0xcd, dstBytes);
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				kernel(args);
+				run.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				if (!run.threads)
+					continue;
+
+				const unsigned char *want = &expected[pl.dstOffset];
+				for (size_t k = 0; k < samples; k++) {
+					double a = sampleAt(out, k, pl.dstBitDepth), b = sampleAt(want, k, pl.dstBitDepth);
+					if (!(a == b)) {
+						run.differing++;
+						if (!(std::fabs(a - b) <= run.maxError))
+							run.maxError = std::fabs(a - b);
+					}
+				}
+			}
+		}
+	}
+	if (frames == 0)
+		fail("no frames to verify");
+
+	fprintf(p->out, "%-40s %10s %10s %10s %8s\n", "kernel", "max error", "differing", "ms/frame", "speedup");
+	int failed = 0;
+	double reference = 0;
+	for (size_t r = 0; r < runs.size(); r++) {
+		const VerifyRun &run = runs[r];
+		char label[64];
+		if (run.threads)
+			snprintf(label, sizeof(label), "%u thread%s, strip %d%s%s%s", run.threads, run.threads == 1 ? "" : "s",
+				run.stripWidth, run.masked ? ", mask" : "",
+				run.variants & kSoftHalf ? ", soft half" : "", run.variants & kUnkeyedFloat ? ", unkeyed" : "");
+		else {
+			snprintf(label, sizeof(label), "reference%s", run.masked ? ", mask" : "");
+			reference = run.seconds;
+		}
+		fprintf(p->out, "%-40s %10g %10lld %10.1f %8.2f\n", label, run.maxError, run.differing,
+			run.seconds * 1000 / frames, run.seconds > 0 ? reference / run.seconds : 0.);
+		if (run.differing)
+			failed++;
+	}
+	fflush(p->out);
+
+	if (failed)
+		fprintf(stderr, "debandpipe: %lld frames, %d of %d kernel runs differ from the reference\n", frames, failed, (int)runs.size() - 2);
+	else
+		fprintf(stderr, "debandpipe: %lld frames, every kernel run matches the reference\n", frames);
+	if (edtWrong)
+		fprintf(stderr, "debandpipe: the distance transform is off brute force at %lld pixels\n", edtWrong);
+	return failed || edtWrong ? 1 : 0;
+}
+
+
+// ===================================================== //
+
+static void usage()
+{
+	fprintf(stderr,
+		"usage: debandpipe [options] < in > out\n"
+		"  -i FILE, -o FILE      read/write a file instead of stdin/stdout\n"
+		"  --raw WxH             raw frames instead of y4m\n"
+		"  --format F            raw pixel format: rgba8, rgba16, rgbah, rgbaf, or rgb8 etc. (default rgba8)\n"
+		"  --out-format F        write raw frames deeper: 8 bit to 16 or f, 16 bit to f (default --format)\n"
+		"  --mode M              ramps (default) or distance\n"
+		"  --direction D         both (default), rows or columns\n"
+		"  --no-dither           round instead of dithering integer output\n"
+		"  --keep-edges          move band ends at most half a step\n"
+		"  --luma                deband raw RGB(A) in luma only, leaving chroma alone\n"
+		"  --budget MS           milliseconds per frame; frames that won't make it get rows only\n"
+		"  --verify              check the kernel against the reference instead of writing frames\n"
+		"  --synthetic N         make up N banded raw frames instead of reading any\n"
+		"  -j N                  frames debanded at once (default: one per core)\n"
+		"  -t N                  threads per frame (default 1)\n"
+		"  -q N                  frames in flight, reading to writing (default 2 per worker)\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	const char *inName = 0, *outName = 0, *rawSize = 0, *format = "rgba8", *outFormat = 0;
+	int workers = (int)std::thread::hardware_concurrency();
+	int threads = 1;
+	int depth = 0;
+
+	Pipeline p;
+	p.mode = kModeRamps;
+	p.direction = kDirBoth;
+	p.dither = true;
+	p.keepEdges = false;
+	p.luma = false;
+	p.budget = 0;
+	p.synthetic = 0;
+	bool verifying = false;
+
+	for (int i = 1; i < argc; i++) {
+		const char *a = argv[i];
+		const char *v = i + 1 < argc ? argv[i + 1] : 0;
+		if (strcmp(a, "--no-dither") == 0) { p.dither = false; continue; }
+		if (strcmp(a, "--keep-edges") == 0) { p.keepEdges = true; continue; }
+		if (strcmp(a, "--luma") == 0) { p.luma = true; continue; }
+		if (strcmp(a, "--verify") == 0) { verifying = true; continue; }
+		if (!v)
+			usage();
+		i++;
+		if (strcmp(a, "-i") == 0) inName = v;
+		else if (strcmp(a, "-o") == 0) outName = v;
+		else if (strcmp(a, "--raw") == 0) rawSize = v;
+		else if (strcmp(a, "--format") == 0) format = v;
+		else if (strcmp(a, "--out-format") == 0) outFormat = v;
+		else if (strcmp(a, "--mode") == 0) p.mode = strcmp(v, "distance") == 0 ? kModeDistance : kModeRamps;
+		else if (strcmp(a, "--direction") == 0)
+			p.direction = strcmp(v, "rows") == 0 ? kDirRows : strcmp(v, "columns") == 0 ? kDirColumns : kDirBoth;
+		else if (strcmp(a, "--budget") == 0) p.budget = atof(v) / 1000.;
+		else if (strcmp(a, "--synthetic") == 0) p.synthetic = atoll(v);
+		else if (strcmp(a, "-j") == 0) workers = atoi(v);
+		else if (strcmp(a, "-t") == 0) threads = atoi(v);
+		else if (strcmp(a, "-q") == 0) depth = atoi(v);
+		else usage();
+	}
+	if (workers < 1)
+		workers = 1;
+	if (threads < 1)
+		threads = 1;
+	if (depth < workers + 1)
+		depth = depth > 0 ? workers + 1 : 2 * workers;
+
+	p.in = inName ? fopen(inName, "rb") : stdin;
+	p.out = outName ? fopen(outName, "wb") : stdout;
+	if (!p.in) fail("can't open ", inName);
+	if (!p.out) fail("can't create ", outName);
+#ifdef _WIN32
+	_setmode(_fileno(p.in), _O_BINARY);
+	_setmode(_fileno(p.out), _O_BINARY);
+#endif
+
+	if (rawSize)
+		setupRaw(p.stream, rawSize, format, outFormat);
+	else if (outFormat)
+		fail("--out-format needs --raw");
+	else if (p.synthetic > 0)
+		fail("--synthetic needs --raw");
+	else {
+		p.stream.y4m = true;
+		parseY4mHeader(p.in, p.stream);
+	}
+
+	if (verifying) {
+		p.slots.resize(1);
+		p.slots[0].src.resize(p.stream.frameBytes);
+		p.slots[0].dst.resize(p.stream.dstFrameBytes);
+		return verify(&p);
+	}
+
+	// all frame memory up front
+	p.slots.resize(depth);
+	for (size_t i = 0; i < p.slots.size(); i++) {
+		p.slots[i].state = kSlotFree;
+		p.slots[i].seq = -1;
+		p.slots[i].src.resize(p.stream.frameBytes);
+		p.slots[i].dst.resize(p.stream.dstFrameBytes);
+	}
+	p.nextWork = 0;
+	p.frameCount = -1;
+	p.budgets.reset(new FrameBudget[p.stream.planes.size()]);
+	p.degradedFrames = 0;
+	p.warmAllocations = 0;
+
+	std::thread readThread(reader, &p);
+	std::deque<Worker> workerData;	// stays put as it grows, for the threads
+	std::vector<std::thread> workThreads;
+	for (int i = 0; i < workers; i++) {
+		workerData.emplace_back(threads);
+		workThreads.emplace_back(worker, &p, &workerData.back());
+	}
+
+	startMetrics();
+	long long frames = writer(&p);
+
+	readThread.join();
+	for (size_t i = 0; i < workThreads.size(); i++)
+		workThreads[i].join();
+
+	stopMetrics();
+	if (p.budget > 0)
+		fprintf(stderr, "debandpipe: %lld frames, %lld of them rows only to meet the budget\n", frames, (long long)p.degradedFrames);
+	else
+		fprintf(stderr, "debandpipe: %lld frames\n", frames);
+
+	// With made-up frames the run is repeatable, so it doubles as the check
+	// that frames allocate nothing once warmed up.  Not with a budget, though:
+	// that can switch a worker from rows only to the full kernel at any frame,
+	// and the full kernel's first frame warms up again.
+	if (p.synthetic > 0) {
+		fprintf(stderr, "debandpipe: %lld allocations in frames after each worker's first %lld\n",
+			(long long)p.warmAllocations, kWarmupFrames);
+		if (p.warmAllocations > 0 && p.budget <= 0)
+			return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,94 @@
+#include "DistanceTransform.h"
+
+void distanceTransform1D(const double *f, int n, int *nearest, double *d2, int *v, double *z)
+{
+	// build the lower envelope; k is the index of its rightmost parabola
+	int k = -1;
+	for (int q = 0; q < n; q++)
+	{
+		if (f[q] >= kDistInfinity)
+			continue;
+
+		if (k < 0)
+		{
+			k = 0;
+			v[0] = q;
+			z[0] = -kDistInfinity;
+			z[1] = kDistInfinity;
+			continue;
+		}
+
+		// intersection with the rightmost parabola; drop parabolas it hides.
+		// z[0] is -infinity, so this always stops at k >= 0.
+		double s;
+		for (;;)
+		{
+			int p = v[k];
+			s = ((f[q] + (double)q * q) - (f[p] + (double)p * p)) / (2.0 * (q - p));
+			if (s > z[k])
+				break;
+			k--;
+		}
+
+		k++;
+		v[k] = q;
+		z[k] = s;
+		z[k + 1] = kDistInfinity;
+	}
+
+	if (k < 0)
+	{
+		for (int q = 0; q < n; q++)
+		{
+			nearest[q] = -1;
+			d2[q] = kDistInfinity;
+		}
+		return;
+	}
+
+	// read the envelope back out
+	int j = 0;
+	for (int q = 0; q < n; q++)
+	{
+		while (z[j + 1] < q)
+			j++;
+		int p = v[j];
+		nearest[q] = p;
+		d2[q] = (double)(q - p) * (q - p) + f[p];
+	}
+}
+
+void nearestSeedColumns(const unsigned char *flags, int w, int h, ptrdiff_t stride,
+	unsigned char mask, unsigned char want, int *nearest, int *last)
+{
+	// down: the nearest seed at or above
+	for (int x = 0; x < w; x++)
+		last[x] = -1;
+	for (int y = 0; y < h; y++)
+	{
+		const unsigned char *f = flags + y * stride;
+		int *n = nearest + y * stride;
+		for (int x = 0; x < w; x++)
+		{
+			if ((f[x] & mask) == want)
+				last[x] = y;
+			n[x] = last[x];
+		}
+	}
+
+	// up: the nearest below, if it's strictly nearer
+	for (int x = 0; x < w; x++)
+		last[x] = -1;
+	for (int y = h - 1; y >= 0; y--)
+	{
+		const unsigned char *f = flags + y * stride;
+		int *n = nearest + y * stride;
+		for (int x = 0; x < w; x++)
+		{
+			if ((f[x] & mask) == want)
+				last[x] = y;
+			if (last[x] >= 0 && (n[x] < 0 || last[x] - y < y - n[x]))
+				n[x] = last[x];
+		}
+	}
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+
+////////////////////////////////////////////////////////////////////////////////
+// Exact Euclidean distance transform helpers, after
+//   Felzenszwalb & Huttenlocher, "Distance Transforms of Sampled Functions"
+//
+// The 2-D transform is separable: nearestSeedColumns() down each column,
+// then distanceTransform1D() along each row on the squared column
+// distances.  Both passes are linear in the number of pixels, and each
+// runs over the whole axis, so the result is the exact distance to the
+// nearest seed anywhere.
+
+// f[] values at or above this are "no site here"
+const double kDistInfinity = 1e30;
+
+// Lower envelope of the parabolas (q - i)^2 + f[i] over 0 <= i < n.
+// On return nearest[q] is the index of the closest site (-1 if f[] had
+// no sites at all) and d2[q] the squared distance to it.
+// v and z are scratch and must hold n and n + 1 entries.
+void distanceTransform1D(const double *f, int n, int *nearest, double *d2, int *v, double *z);
+
+// Nearest seed up or down each of w adjacent columns, h rows of stride
+// entries: seeds are where (flags & mask) == want.  nearest[], laid out
+// like flags, gets the row of the nearest seed in its column, or -1; ties
+// go to the upper one.  Walks row by row, so it reads memory in order.
+// last is scratch and must hold w entries.
+void nearestSeedColumns(const unsigned char *flags, int w, int h, ptrdiff_t stride,
+	unsigned char mask, unsigned char want, int *nearest, int *last);
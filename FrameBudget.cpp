@@ -0,0 +1,58 @@
+#include "FrameBudget.h"
+#include "DebandCore.h"
+#include "Metrics.h"
+#include <chrono>
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool FrameBudget::render(KernelFn full, KernelFn rows, const KernelArgs &args, double budget)
+{
+	double expected, ratio;
+	{
+		std::lock_guard<std::mutex> l(lock);
+		expected = fullSeconds;
+		ratio = fullOverRows;
+	}
+
+	// The frames before say the whole thing fits.  Rows won't run too:
+	// full would only write over them.
+	if (expected > 0 && expected <= budget) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		full(args);
+		double seconds = secondsSince(start);
+		if (debandCancelled(args.host))
+			return false;
+
+		std::lock_guard<std::mutex> l(lock);
+		fullSeconds = seconds;
+		if (rowSeconds > 0)
+			fullOverRows = seconds / rowSeconds;
+		rowSeconds = 0;
+		if (seconds > budget)
+			count(metrics.budgetOverruns);
+		return false;
+	}
+
+	KernelArgs rowArgs = args;
+	rowArgs.mode = kModeRamps;
+	if (args.profile)
+		rowArgs.profile = &rowsProfile;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	rows(rowArgs);
+	double seconds = secondsSince(start);
+	if (debandCancelled(args.host))
+		return false;
+
+	// Scale the guess by the rows, so a frame that gets cheaper gets full again.
+	std::lock_guard<std::mutex> l(lock);
+	rowSeconds = seconds;
+	fullSeconds = seconds * ratio;
+	if (seconds > budget)
+		count(metrics.budgetOverruns);
+	count(metrics.degradedFrames);
+	return true;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <mutex>
+#include "KernelTable.h"
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Holds renders to a time budget for live playback, where a late frame is
+// a dropped frame.  The rows-only ramps are the cheapest pass that still
+// debands, so a frame whose full render looks too dear gets just the rows,
+// and is counted as degraded.  Each frame runs one kernel or the other,
+// picked before it starts from what the frames before it cost; the rows
+// of a degraded frame say what full would have cost, so playback goes
+// back to full the frame after the content gets cheap enough.
+
+// full's cost over rows' until consecutive frames have measured both;
+// ramps in both directions run about 3 times the rows alone
+const double kDefaultFullOverRows = 3.;
+
+// One per effect instance.  Renders of one instance may run at once, hence
+// the lock.
+class FrameBudget {
+public:
+	FrameBudget() : fullSeconds(0), rowSeconds(0), fullOverRows(kDefaultFullOverRows) {}
+
+	// Render args with full, or with just rows (a kDirRows ramps kernel of
+	// the same depth) if full won't fit in budget seconds.  Until a frame
+	// has said what full costs, frames get rows.  Returns true if the
+	// frame was cut down to rows.
+	bool render(KernelFn full, KernelFn rows, const KernelArgs &args, double budget);
+
+private:
+	std::mutex lock;
+	double fullSeconds;		// what full should cost next frame; 0 until known
+	double rowSeconds;		// what rows cost last frame, or 0 if it ran full
+	double fullOverRows;	// full's cost over rows', from the last frame of each in a row
+
+	// rows slice the frame the other way from full, so they're profiled apart
+	CostProfile rowsProfile;
+};
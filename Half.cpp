@@ -0,0 +1,46 @@
+#include "Half.h"
+
+#if HALF_HAVE_F16C && defined(_MSC_VER)
+#include <intrin.h>
+#elif HALF_HAVE_F16C
+#include <cpuid.h>
+#endif
+
+static bool detectF16C()
+{
+#if HALF_HAVE_F16C
+	// CPUID leaf 1: ECX bit 29 is F16C, 28 AVX, 27 OSXSAVE
+	unsigned int ecx;
+#if defined(_MSC_VER)
+	int regs[4];
+	__cpuid(regs, 1);
+	ecx = (unsigned int)regs[2];
+#else
+	unsigned int eax, ebx, edx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return false;
+#endif
+	const unsigned int need = (1u << 29) | (1u << 28) | (1u << 27);
+	if ((ecx & need) != need)
+		return false;
+
+	// F16C is VEX encoded, so the OS has to save the YMM registers too
+	unsigned long long xcr0;
+#if defined(_MSC_VER)
+	xcr0 = _xgetbv(0);
+#else
+	unsigned int lo, hi;
+	__asm__ ("xgetbv" : "=a" (lo), "=d" (hi) : "c" (0));
+	xcr0 = ((unsigned long long)hi << 32) | lo;
+#endif
+	return (xcr0 & 6) == 6;
+#else
+	return false;
+#endif
+}
+
+bool halfHasF16C()
+{
+	static const bool has = detectF16C();
+	return has;
+}
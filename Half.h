@@ -0,0 +1,232 @@
+#pragma once
+#include <cstring>
+#include "ofxPixels.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// 16-bit float pixels, for hosts that hand us kOfxBitDepthHalf.
+//
+// Halves are storage only: they get widened to float to do any math and
+// narrowed again on the way out.  With F16C a whole RGBA pixel converts
+// in one instruction; otherwise it's done in software, rounding to nearest
+// even just like the hardware.
+//
+// Whether the CPU has F16C is only known when we run, so the half kernels
+// are built twice, and KernelTable.cpp picks by halfHasF16C(): once on
+// BasicHalf<false> pixels, which convert in software unless the whole
+// build targets F16C (-mf16c, /arch:AVX2), and once on BasicHalf<true>
+// ones, which always use it.  Only the conversions are F16C code.  MSVC
+// takes the intrinsics at any /arch, and GCC and Clang get them through
+// a target attribute, so no AVX code leaks into the inline functions the
+// two builds share.
+
+#if defined(__F16C__) || defined(__AVX2__)
+#define HALF_USE_F16C 1		// the whole build may use F16C
+#else
+#define HALF_USE_F16C 0
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define HALF_HAVE_F16C 1	// F16C code can be built, to run where the CPU has it
+#include <immintrin.h>
+#else
+#define HALF_HAVE_F16C 0
+#endif
+
+#if HALF_HAVE_F16C && (defined(__GNUC__) || defined(__clang__))
+#define HALF_F16C_CODE __attribute__((target("f16c")))
+#else
+#define HALF_F16C_CODE
+#endif
+
+// whether this CPU has F16C, and the OS saves the AVX state it needs
+bool halfHasF16C();
+
+inline float halfToFloatSoft(unsigned short h)
+{
+	unsigned int sign = (unsigned int)(h & 0x8000) << 16;
+	unsigned int exp = (h >> 10) & 0x1f;
+	unsigned int mant = h & 0x3ff;
+	unsigned int bits;
+
+	if (exp == 0x1f)
+		bits = sign | 0x7f800000 | (mant << 13);		// inf, nan
+	else if (exp != 0)
+		bits = sign | ((exp + 112) << 23) | (mant << 13);	// normal
+	else if (mant == 0)
+		bits = sign;									// zero
+	else
+	{
+		// denormal; renormalise it for float
+		exp = 113;
+		while (!(mant & 0x400))
+		{
+			mant <<= 1;
+			exp--;
+		}
+		bits = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+	}
+
+	float f;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+inline unsigned short floatToHalfSoft(float f)
+{
+	unsigned int x;
+	memcpy(&x, &f, sizeof(x));
+	unsigned int sign = (x >> 16) & 0x8000;
+	unsigned int mant = x & 0x7fffff;
+	int exp = (int)((x >> 23) & 0xff) - 127 + 15;
+
+	if (((x >> 23) & 0xff) == 0xff)
+		return (unsigned short)(sign | 0x7c00 | (mant ? 0x200 : 0));	// inf, nan
+	if (exp >= 0x1f)
+		return (unsigned short)(sign | 0x7c00);		// too big, goes to inf
+
+	if (exp <= 0)
+	{
+		// denormal half, or rounds to zero
+		if (exp < -10)
+			return (unsigned short)sign;
+		mant |= 0x800000;
+		int shift = 14 - exp;
+		unsigned int h = mant >> shift;
+		unsigned int rem = mant & ((1u << shift) - 1);
+		unsigned int halfway = 1u << (shift - 1);
+		if (rem > halfway || (rem == halfway && (h & 1)))
+			h++;
+		return (unsigned short)(sign | h);
+	}
+
+	// a carry out of the mantissa bumps the exponent, which is correct
+	unsigned int h = ((unsigned int)exp << 10) | (mant >> 13);
+	unsigned int rem = mant & 0x1fff;
+	if (rem > 0x1000 || (rem == 0x1000 && (h & 1)))
+		h++;
+	return (unsigned short)(sign | h);
+}
+
+// The F16C conversions, one value or four.  Only call them where
+// halfHasF16C() says so.  Builds that can't have F16C get the software
+// ones under the same names, so the kernels still compile.
+#if HALF_HAVE_F16C
+HALF_F16C_CODE inline float halfToFloatF16C(unsigned short h)
+{
+	return _cvtsh_ss(h);
+}
+
+HALF_F16C_CODE inline unsigned short floatToHalfF16C(float f)
+{
+	return (unsigned short)_cvtss_sh(f, 0);
+}
+
+HALF_F16C_CODE inline void halfToFloatF16C(const unsigned short *h, float *f)
+{
+	_mm_storeu_ps(f, _mm_cvtph_ps(_mm_loadl_epi64((const __m128i *)h)));
+}
+
+HALF_F16C_CODE inline void floatToHalfF16C(const float *f, unsigned short *h)
+{
+	_mm_storel_epi64((__m128i *)h, _mm_cvtps_ph(_mm_loadu_ps(f), 0));
+}
+#else
+inline float halfToFloatF16C(unsigned short h) { return halfToFloatSoft(h); }
+inline unsigned short floatToHalfF16C(float f) { return floatToHalfSoft(f); }
+
+inline void halfToFloatF16C(const unsigned short *h, float *f)
+{
+	for (int k = 0; k < 4; k++)
+		f[k] = halfToFloatSoft(h[k]);
+}
+
+inline void floatToHalfF16C(const float *f, unsigned short *h)
+{
+	for (int k = 0; k < 4; k++)
+		h[k] = floatToHalfSoft(f[k]);
+}
+#endif
+
+// what the build can use everywhere
+inline float halfToFloat(unsigned short h)
+{
+#if HALF_USE_F16C
+	return halfToFloatF16C(h);
+#else
+	return halfToFloatSoft(h);
+#endif
+}
+
+inline unsigned short floatToHalf(float f)
+{
+#if HALF_USE_F16C
+	return floatToHalfF16C(f);
+#else
+	return floatToHalfSoft(f);
+#endif
+}
+
+// One channel; F16C says it may convert with F16C.  Equality compares the
+// bit patterns, so band detection never has to widen anything, except that
+// -0 equals +0, as it does for float.
+template <bool F16C>
+struct BasicHalf {
+	unsigned short bits;
+
+	operator float() const { return F16C ? halfToFloatF16C(bits) : halfToFloat(bits); }
+	BasicHalf &operator=(float f) { bits = F16C ? floatToHalfF16C(f) : floatToHalf(f); return *this; }
+	bool operator==(const BasicHalf &o) const { return bits == o.bits || ((bits | o.bits) & 0x7fff) == 0; }
+	bool operator!=(const BasicHalf &o) const { return !(*this == o); }
+};
+
+// pixel layouts matching the other OfxRGBAColour and OfxRGBColour types
+template <bool F16C>
+struct BasicRGBAColourH {
+	BasicHalf<F16C> r, g, b, a;
+};
+
+template <bool F16C>
+struct BasicRGBColourH {
+	BasicHalf<F16C> r, g, b;
+};
+
+// what everything but the F16C kernels uses
+typedef BasicHalf<false> Half;
+typedef BasicRGBAColourH<false> OfxRGBAColourH;
+typedef BasicRGBColourH<false> OfxRGBColourH;
+
+// the F16C kernels' pixels
+typedef BasicHalf<true> HalfF16C;
+typedef BasicRGBAColourH<true> OfxRGBAColourHF16C;
+typedef BasicRGBColourH<true> OfxRGBColourHF16C;
+
+// whole-pixel conversions
+template <bool F16C> inline
+OfxRGBAColourF halfToFloat(const BasicRGBAColourH<F16C> &p)
+{
+	OfxRGBAColourF c;
+	if (F16C || HALF_USE_F16C)
+		halfToFloatF16C(&p.r.bits, &c.r);
+	else
+	{
+		c.r = p.r;
+		c.g = p.g;
+		c.b = p.b;
+		c.a = p.a;
+	}
+	return c;
+}
+
+template <bool F16C> inline
+void floatToHalf(BasicRGBAColourH<F16C> &p, const OfxRGBAColourF &c)
+{
+	if (F16C || HALF_USE_F16C)
+		floatToHalfF16C(&c.r, &p.r.bits);
+	else
+	{
+		p.r = c.r;
+		p.g = c.g;
+		p.b = c.b;
+		p.a = c.a;
+	}
+}
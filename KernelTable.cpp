@@ -0,0 +1,412 @@
+#include "KernelTable.h"
+
+#include <cstring>
+#include "ProcessRGBA.h"
+#include "ProcessDiagnostic.h"
+#include "ProcessLuma.h"
+
+// The scratch a render works in: the caller's, or else own.  The frame
+// arena starts empty.
+static Scratch &renderScratch(const KernelArgs &a, Scratch &own)
+{
+	Scratch &s = a.scratch ? *a.scratch : own;
+	s.frame.reset();
+	return s;
+}
+
+// construct and run one variant; halfStep is in source units, and levels
+// the float source's grid, if it has one
+template <class PIX, class MASK, int max, int isFloat, int DIR, bool MASKED, bool DITHER, bool KEYED, class DPIX = PIX>
+static void runVariant(const KernelArgs &a, float halfStep, int levels = 0)
+{
+	ProcessRGBA<PIX, MASK, max, isFloat, DIR, MASKED, DITHER, KEYED, DPIX> fred(a.host,
+		a.src, a.srcRect, a.srcRowBytes,
+		a.dst, a.dstRect, a.dstRowBytes,
+		a.mask, a.maskRect, a.maskRowBytes,
+		a.window, a.mode);
+	Scratch own;
+	fred.profile = a.profile;
+	fred.scratch = &renderScratch(a, own);
+	fred.halfStep = halfStep * fred.srcScale();
+	if (levels > 0)
+		fred.codes = (float)levels;
+	fred.process();
+
+	if (a.stats) {
+		a.stats->passSeconds = fred.passSeconds();
+		a.stats->sliceTimings = fred.sliceTimings();
+	}
+}
+
+// integer and half pixels, written out at their own depth or a deeper
+// one; a step is one code, or unknown for half
+template <class PIX, class MASK, int max, int isFloat, int DIR, bool MASKED, bool DITHER, class DPIX = PIX>
+static void runKernel(const KernelArgs &a)
+{
+	runVariant<PIX, MASK, max, isFloat, DIR, MASKED, DITHER, false, DPIX>(a, a.halfStep && !isFloat ? 0.5f : 0.f);
+}
+
+// Float pixels: if the source sits on a grid, band ends can be limited to
+// half a step, and bands found by comparing bits, unless KEYS is false.
+template <class PIX, int DIR, bool MASKED, bool KEYS = true>
+static void runFloatKernel(const KernelArgs &a)
+{
+	int levels = a.quant ? a.quant->find(a.src, a.srcRect, a.srcRowBytes, a.window, PixelLayout<PIX>::N) : 0;
+	float halfStep = a.halfStep && levels > 0 ? 0.5f / levels : 0.f;
+
+	if (KEYS && levels > 0)
+		runVariant<PIX, float, 1, 1, DIR, MASKED, false, true>(a, halfStep, levels);
+	else
+		runVariant<PIX, float, 1, 1, DIR, MASKED, false, false>(a, halfStep, levels);
+}
+
+// append one processor's timings to stats, if it's set
+static void addStats(KernelStats *stats, const Processor &p)
+{
+	if (!stats)
+		return;
+	stats->passSeconds.insert(stats->passSeconds.end(), p.passSeconds().begin(), p.passSeconds().end());
+	stats->sliceTimings.insert(stats->sliceTimings.end(), p.sliceTimings().begin(), p.sliceTimings().end());
+}
+
+// Luma only: split out Y, deband it as a one-channel float image, and add
+// the change back to R, G and B.
+template <class PIX, class MASK, int max, int isFloat, int DIR, bool MASKED, bool DITHER, class DPIX = PIX>
+static void runLuma(const KernelArgs &a)
+{
+	typedef ProcessLuma<PIX, MASK, max, isFloat, DIR, MASKED, DITHER, DPIX> Luma;
+	int w = a.window.x2 - a.window.x1, h = a.window.y2 - a.window.y1;
+	Scratch own;
+	Scratch &scratch = renderScratch(a, own);
+
+	// Ramps one way only go a strip at a time, with no planes of Y.
+	bool strips = a.mode == kModeRamps && DIR != kDirBoth;
+	float *luma = strips ? 0 : scratch.frame.take<float>((size_t)w * h);
+	float *lumaOut = strips ? 0 : scratch.frame.take<float>((size_t)w * h);
+
+	// The three share scratch, so each one's timings go before the next runs.
+	if (a.stats) {
+		a.stats->passSeconds.clear();
+		a.stats->sliceTimings.clear();
+	}
+	Luma split(a.host,
+		a.src, a.srcRect, a.srcRowBytes,
+		a.dst, a.dstRect, a.dstRowBytes,
+		a.mask, a.maskRect, a.maskRowBytes,
+		a.window, luma, lumaOut);
+	split.scratch = &scratch;
+
+	// Y is in the same units as the channels, so an integer step is still
+	// about one source code; float needs the source's grid
+	float halfStep = 0;
+	if (a.halfStep && !isFloat)
+		halfStep = 0.5f * split.srcScale();
+	else if (a.halfStep && a.quant && std::is_same<typename PixelLayout<PIX>::T, float>::value) {
+		int levels = a.quant->find(a.src, a.srcRect, a.srcRowBytes, a.window, PixelLayout<PIX>::N);
+		halfStep = levels > 0 ? 0.5f / levels : 0.f;
+	}
+
+	if (strips) {
+		split.stage = split.kStrips;
+		split.lumaHalfStep = halfStep;
+		split.profile = a.profile;
+		split.process();
+		addStats(a.stats, split);
+		return;
+	}
+
+	split.process();
+	addStats(a.stats, split);
+
+	ProcessRGBA<float, float, 1, 1, DIR> fred(a.host,
+		luma, a.window, w * (int)sizeof(float),
+		lumaOut, a.window, w * (int)sizeof(float),
+		0, a.window, 0,
+		a.window, a.mode);
+	fred.profile = a.profile;
+	fred.scratch = &scratch;
+	fred.halfStep = halfStep;
+	fred.process();
+	addStats(a.stats, fred);
+
+	Luma merge(a.host,
+		a.src, a.srcRect, a.srcRowBytes,
+		a.dst, a.dstRect, a.dstRowBytes,
+		a.mask, a.maskRect, a.maskRowBytes,
+		a.window, luma, lumaOut);
+	merge.scratch = &scratch;
+	merge.stage = merge.kMerge;
+	merge.process();
+	addStats(a.stats, merge);
+}
+
+template <class PIX, class MASK, int max, int isFloat, class DPIX = PIX>
+static void runDiagnostic(const KernelArgs &a, int diagnostic, KernelStats &stats)
+{
+	ProcessDiagnostic<PIX, MASK, max, isFloat, DPIX> fred(a.host,
+		a.src, a.srcRect, a.srcRowBytes,
+		a.dst, a.dstRect, a.dstRowBytes,
+		a.window, diagnostic, stats);
+	Scratch own;
+	fred.scratch = &renderScratch(a, own);
+	fred.process();
+	fred.collect();
+}
+
+// [direction][masked] for one pixel type and dither setting
+#define KERNEL_VARIANTS(PIX, MASK, max, isFloat, DITHER) \
+	{ \
+		{ runKernel<PIX, MASK, max, isFloat, kDirBoth, false, DITHER>, runKernel<PIX, MASK, max, isFloat, kDirBoth, true, DITHER> }, \
+		{ runKernel<PIX, MASK, max, isFloat, kDirRows, false, DITHER>, runKernel<PIX, MASK, max, isFloat, kDirRows, true, DITHER> }, \
+		{ runKernel<PIX, MASK, max, isFloat, kDirColumns, false, DITHER>, runKernel<PIX, MASK, max, isFloat, kDirColumns, true, DITHER> } \
+	}
+
+// [direction][masked] for float pixels, which never dither
+#define FLOAT_VARIANTS(PIX) \
+	{ \
+		{ runFloatKernel<PIX, kDirBoth, false>, runFloatKernel<PIX, kDirBoth, true> }, \
+		{ runFloatKernel<PIX, kDirRows, false>, runFloatKernel<PIX, kDirRows, true> }, \
+		{ runFloatKernel<PIX, kDirColumns, false>, runFloatKernel<PIX, kDirColumns, true> } \
+	}
+
+// [direction][masked] for float pixels, comparing as floats on a grid too
+#define UNKEYED_FLOAT_VARIANTS(PIX) \
+	{ \
+		{ runFloatKernel<PIX, kDirBoth, false, false>, runFloatKernel<PIX, kDirBoth, true, false> }, \
+		{ runFloatKernel<PIX, kDirRows, false, false>, runFloatKernel<PIX, kDirRows, true, false> }, \
+		{ runFloatKernel<PIX, kDirColumns, false, false>, runFloatKernel<PIX, kDirColumns, true, false> } \
+	}
+
+// [depth][RGBA, alpha, RGB][dither][direction][masked]
+// Dithering only means anything when rounding to integers, so the float
+// and half rows just repeat their undithered kernels.
+static const KernelFn kernels[4][3][2][3][2] = {
+	{	// 8 bit
+		{ KERNEL_VARIANTS(OfxRGBAColourB, unsigned char, 255, 0, false), KERNEL_VARIANTS(OfxRGBAColourB, unsigned char, 255, 0, true) },
+		{ KERNEL_VARIANTS(unsigned char, unsigned char, 255, 0, false), KERNEL_VARIANTS(unsigned char, unsigned char, 255, 0, true) },
+		{ KERNEL_VARIANTS(OfxRGBColourB, unsigned char, 255, 0, false), KERNEL_VARIANTS(OfxRGBColourB, unsigned char, 255, 0, true) }
+	},
+	{	// 16 bit
+		{ KERNEL_VARIANTS(OfxRGBAColourS, unsigned short, 65535, 0, false), KERNEL_VARIANTS(OfxRGBAColourS, unsigned short, 65535, 0, true) },
+		{ KERNEL_VARIANTS(unsigned short, unsigned short, 65535, 0, false), KERNEL_VARIANTS(unsigned short, unsigned short, 65535, 0, true) },
+		{ KERNEL_VARIANTS(OfxRGBColourS, unsigned short, 65535, 0, false), KERNEL_VARIANTS(OfxRGBColourS, unsigned short, 65535, 0, true) }
+	},
+	{	// half
+		{ KERNEL_VARIANTS(OfxRGBAColourH, Half, 1, 1, false), KERNEL_VARIANTS(OfxRGBAColourH, Half, 1, 1, false) },
+		{ KERNEL_VARIANTS(Half, Half, 1, 1, false), KERNEL_VARIANTS(Half, Half, 1, 1, false) },
+		{ KERNEL_VARIANTS(OfxRGBColourH, Half, 1, 1, false), KERNEL_VARIANTS(OfxRGBColourH, Half, 1, 1, false) }
+	},
+	{	// float
+		{ FLOAT_VARIANTS(OfxRGBAColourF), FLOAT_VARIANTS(OfxRGBAColourF) },
+		{ FLOAT_VARIANTS(float), FLOAT_VARIANTS(float) },
+		{ FLOAT_VARIANTS(OfxRGBColourF), FLOAT_VARIANTS(OfxRGBColourF) }
+	}
+};
+
+// The float row of the table above, for kUnkeyedFloat.
+// [RGBA, alpha, RGB][direction][masked]
+static const KernelFn unkeyedFloatKernels[3][3][2] = {
+	UNKEYED_FLOAT_VARIANTS(OfxRGBAColourF),
+	UNKEYED_FLOAT_VARIANTS(float),
+	UNKEYED_FLOAT_VARIANTS(OfxRGBColourF)
+};
+
+// [direction][masked] luma-only kernels for one RGB or RGBA pixel type and dither setting
+#define LUMA_VARIANTS(PIX, MASK, max, isFloat, DITHER) \
+	{ \
+		{ runLuma<PIX, MASK, max, isFloat, kDirBoth, false, DITHER>, runLuma<PIX, MASK, max, isFloat, kDirBoth, true, DITHER> }, \
+		{ runLuma<PIX, MASK, max, isFloat, kDirRows, false, DITHER>, runLuma<PIX, MASK, max, isFloat, kDirRows, true, DITHER> }, \
+		{ runLuma<PIX, MASK, max, isFloat, kDirColumns, false, DITHER>, runLuma<PIX, MASK, max, isFloat, kDirColumns, true, DITHER> } \
+	}
+
+// [depth][RGBA, RGB][dither][direction][masked]
+static const KernelFn lumaKernels[4][2][2][3][2] = {
+	{	// 8 bit
+		{ LUMA_VARIANTS(OfxRGBAColourB, unsigned char, 255, 0, false), LUMA_VARIANTS(OfxRGBAColourB, unsigned char, 255, 0, true) },
+		{ LUMA_VARIANTS(OfxRGBColourB, unsigned char, 255, 0, false), LUMA_VARIANTS(OfxRGBColourB, unsigned char, 255, 0, true) }
+	},
+	{	// 16 bit
+		{ LUMA_VARIANTS(OfxRGBAColourS, unsigned short, 65535, 0, false), LUMA_VARIANTS(OfxRGBAColourS, unsigned short, 65535, 0, true) },
+		{ LUMA_VARIANTS(OfxRGBColourS, unsigned short, 65535, 0, false), LUMA_VARIANTS(OfxRGBColourS, unsigned short, 65535, 0, true) }
+	},
+	{	// half
+		{ LUMA_VARIANTS(OfxRGBAColourH, Half, 1, 1, false), LUMA_VARIANTS(OfxRGBAColourH, Half, 1, 1, false) },
+		{ LUMA_VARIANTS(OfxRGBColourH, Half, 1, 1, false), LUMA_VARIANTS(OfxRGBColourH, Half, 1, 1, false) }
+	},
+	{	// float
+		{ LUMA_VARIANTS(OfxRGBAColourF, float, 1, 1, false), LUMA_VARIANTS(OfxRGBAColourF, float, 1, 1, false) },
+		{ LUMA_VARIANTS(OfxRGBColourF, float, 1, 1, false), LUMA_VARIANTS(OfxRGBColourF, float, 1, 1, false) }
+	}
+};
+
+// The half rows of the two tables above again, on pixels that convert with
+// F16C, for CPUs that have it (see Half.h).
+// [RGBA, alpha, RGB][dither][direction][masked]
+static const KernelFn f16cKernels[3][2][3][2] = {
+	{ KERNEL_VARIANTS(OfxRGBAColourHF16C, HalfF16C, 1, 1, false), KERNEL_VARIANTS(OfxRGBAColourHF16C, HalfF16C, 1, 1, false) },
+	{ KERNEL_VARIANTS(HalfF16C, HalfF16C, 1, 1, false), KERNEL_VARIANTS(HalfF16C, HalfF16C, 1, 1, false) },
+	{ KERNEL_VARIANTS(OfxRGBColourHF16C, HalfF16C, 1, 1, false), KERNEL_VARIANTS(OfxRGBColourHF16C, HalfF16C, 1, 1, false) }
+};
+
+// [RGBA, RGB][dither][direction][masked]
+static const KernelFn f16cLuma[2][2][3][2] = {
+	{ LUMA_VARIANTS(OfxRGBAColourHF16C, HalfF16C, 1, 1, false), LUMA_VARIANTS(OfxRGBAColourHF16C, HalfF16C, 1, 1, false) },
+	{ LUMA_VARIANTS(OfxRGBColourHF16C, HalfF16C, 1, 1, false), LUMA_VARIANTS(OfxRGBColourHF16C, HalfF16C, 1, 1, false) }
+};
+
+// [direction][masked] for integer pixels written out at a deeper depth
+#define PROMOTED_VARIANTS(PIX, MASK, max, DITHER, DPIX) \
+	{ \
+		{ runKernel<PIX, MASK, max, 0, kDirBoth, false, DITHER, DPIX>, runKernel<PIX, MASK, max, 0, kDirBoth, true, DITHER, DPIX> }, \
+		{ runKernel<PIX, MASK, max, 0, kDirRows, false, DITHER, DPIX>, runKernel<PIX, MASK, max, 0, kDirRows, true, DITHER, DPIX> }, \
+		{ runKernel<PIX, MASK, max, 0, kDirColumns, false, DITHER, DPIX>, runKernel<PIX, MASK, max, 0, kDirColumns, true, DITHER, DPIX> } \
+	}
+
+// [direction][masked] luma-only kernels written out at a deeper depth
+#define PROMOTED_LUMA_VARIANTS(PIX, MASK, max, DITHER, DPIX) \
+	{ \
+		{ runLuma<PIX, MASK, max, 0, kDirBoth, false, DITHER, DPIX>, runLuma<PIX, MASK, max, 0, kDirBoth, true, DITHER, DPIX> }, \
+		{ runLuma<PIX, MASK, max, 0, kDirRows, false, DITHER, DPIX>, runLuma<PIX, MASK, max, 0, kDirRows, true, DITHER, DPIX> }, \
+		{ runLuma<PIX, MASK, max, 0, kDirColumns, false, DITHER, DPIX>, runLuma<PIX, MASK, max, 0, kDirColumns, true, DITHER, DPIX> } \
+	}
+
+// Debanding an 8 or 16 bit source straight into a deeper output keeps the
+// ramps' in-between values that rounding back to the source's depth would
+// lose, in one pass instead of a conversion after it.
+// [8 to 16, 8 to float, 16 to float][RGBA, alpha, RGB][dither][direction][masked]
+// Float outputs don't dither, as above.
+static const KernelFn promotedKernels[3][3][2][3][2] = {
+	{	// 8 to 16 bit
+		{ PROMOTED_VARIANTS(OfxRGBAColourB, unsigned char, 255, false, OfxRGBAColourS), PROMOTED_VARIANTS(OfxRGBAColourB, unsigned char, 255, true, OfxRGBAColourS) },
+		{ PROMOTED_VARIANTS(unsigned char, unsigned char, 255, false, unsigned short), PROMOTED_VARIANTS(unsigned char, unsigned char, 255, true, unsigned short) },
+		{ PROMOTED_VARIANTS(OfxRGBColourB, unsigned char, 255, false, OfxRGBColourS), PROMOTED_VARIANTS(OfxRGBColourB, unsigned char, 255, true, OfxRGBColourS) }
+	},
+	{	// 8 bit to float
+		{ PROMOTED_VARIANTS(OfxRGBAColourB, unsigned char, 255, false, OfxRGBAColourF), PROMOTED_VARIANTS(OfxRGBAColourB, unsigned char, 255, false, OfxRGBAColourF) },
+		{ PROMOTED_VARIANTS(unsigned char, unsigned char, 255, false, float), PROMOTED_VARIANTS(unsigned char, unsigned char, 255, false, float) },
+		{ PROMOTED_VARIANTS(OfxRGBColourB, unsigned char, 255, false, OfxRGBColourF), PROMOTED_VARIANTS(OfxRGBColourB, unsigned char, 255, false, OfxRGBColourF) }
+	},
+	{	// 16 bit to float
+		{ PROMOTED_VARIANTS(OfxRGBAColourS, unsigned short, 65535, false, OfxRGBAColourF), PROMOTED_VARIANTS(OfxRGBAColourS, unsigned short, 65535, false, OfxRGBAColourF) },
+		{ PROMOTED_VARIANTS(unsigned short, unsigned short, 65535, false, float), PROMOTED_VARIANTS(unsigned short, unsigned short, 65535, false, float) },
+		{ PROMOTED_VARIANTS(OfxRGBColourS, unsigned short, 65535, false, OfxRGBColourF), PROMOTED_VARIANTS(OfxRGBColourS, unsigned short, 65535, false, OfxRGBColourF) }
+	}
+};
+
+// [8 to 16, 8 to float, 16 to float][RGBA, RGB][dither][direction][masked]
+static const KernelFn promotedLuma[3][2][2][3][2] = {
+	{	// 8 to 16 bit
+		{ PROMOTED_LUMA_VARIANTS(OfxRGBAColourB, unsigned char, 255, false, OfxRGBAColourS), PROMOTED_LUMA_VARIANTS(OfxRGBAColourB, unsigned char, 255, true, OfxRGBAColourS) },
+		{ PROMOTED_LUMA_VARIANTS(OfxRGBColourB, unsigned char, 255, false, OfxRGBColourS), PROMOTED_LUMA_VARIANTS(OfxRGBColourB, unsigned char, 255, true, OfxRGBColourS) }
+	},
+	{	// 8 bit to float
+		{ PROMOTED_LUMA_VARIANTS(OfxRGBAColourB, unsigned char, 255, false, OfxRGBAColourF), PROMOTED_LUMA_VARIANTS(OfxRGBAColourB, unsigned char, 255, false, OfxRGBAColourF) },
+		{ PROMOTED_LUMA_VARIANTS(OfxRGBColourB, unsigned char, 255, false, OfxRGBColourF), PROMOTED_LUMA_VARIANTS(OfxRGBColourB, unsigned char, 255, false, OfxRGBColourF) }
+	},
+	{	// 16 bit to float
+		{ PROMOTED_LUMA_VARIANTS(OfxRGBAColourS, unsigned short, 65535, false, OfxRGBAColourF), PROMOTED_LUMA_VARIANTS(OfxRGBAColourS, unsigned short, 65535, false, OfxRGBAColourF) },
+		{ PROMOTED_LUMA_VARIANTS(OfxRGBColourS, unsigned short, 65535, false, OfxRGBColourF), PROMOTED_LUMA_VARIANTS(OfxRGBColourS, unsigned short, 65535, false, OfxRGBColourF) }
+	}
+};
+
+// [depth][RGBA, alpha, RGB]
+static const DiagnosticFn diagnostics[4][3] = {
+	{ runDiagnostic<OfxRGBAColourB, unsigned char, 255, 0>, runDiagnostic<unsigned char, unsigned char, 255, 0>, runDiagnostic<OfxRGBColourB, unsigned char, 255, 0> },
+	{ runDiagnostic<OfxRGBAColourS, unsigned short, 65535, 0>, runDiagnostic<unsigned short, unsigned short, 65535, 0>, runDiagnostic<OfxRGBColourS, unsigned short, 65535, 0> },
+	{ runDiagnostic<OfxRGBAColourH, Half, 1, 1>, runDiagnostic<Half, Half, 1, 1>, runDiagnostic<OfxRGBColourH, Half, 1, 1> },
+	{ runDiagnostic<OfxRGBAColourF, float, 1, 1>, runDiagnostic<float, float, 1, 1>, runDiagnostic<OfxRGBColourF, float, 1, 1> }
+};
+
+// [RGBA, alpha, RGB] for half pixels, with F16C
+static const DiagnosticFn f16cDiagnostics[3] = {
+	runDiagnostic<OfxRGBAColourHF16C, HalfF16C, 1, 1>, runDiagnostic<HalfF16C, HalfF16C, 1, 1>, runDiagnostic<OfxRGBColourHF16C, HalfF16C, 1, 1>
+};
+
+// [8 to 16, 8 to float, 16 to float][RGBA, alpha, RGB]
+static const DiagnosticFn promotedDiagnostics[3][3] = {
+	{ runDiagnostic<OfxRGBAColourB, unsigned char, 255, 0, OfxRGBAColourS>, runDiagnostic<unsigned char, unsigned char, 255, 0, unsigned short>, runDiagnostic<OfxRGBColourB, unsigned char, 255, 0, OfxRGBColourS> },
+	{ runDiagnostic<OfxRGBAColourB, unsigned char, 255, 0, OfxRGBAColourF>, runDiagnostic<unsigned char, unsigned char, 255, 0, float>, runDiagnostic<OfxRGBColourB, unsigned char, 255, 0, OfxRGBColourF> },
+	{ runDiagnostic<OfxRGBAColourS, unsigned short, 65535, 0, OfxRGBAColourF>, runDiagnostic<unsigned short, unsigned short, 65535, 0, float>, runDiagnostic<OfxRGBColourS, unsigned short, 65535, 0, OfxRGBColourF> }
+};
+
+// table row for an ofxuMapPixelDepth value, or -1
+static int depthIndex(int bitDepth)
+{
+	switch (bitDepth) {
+	case 8: return 0;
+	case 16: return 1;
+	case kBitDepthHalf: return 2;
+	case 32: return 3;
+	default: return -1;
+	}
+}
+
+// promoted table row for a source and output depth, or -1
+static int promotionIndex(int srcBitDepth, int dstBitDepth)
+{
+	if (srcBitDepth == 8 && dstBitDepth == 16) return 0;
+	if (srcBitDepth == 8 && dstBitDepth == 32) return 1;
+	if (srcBitDepth == 16 && dstBitDepth == 32) return 2;
+	return -1;
+}
+
+// table column for a number of components, or -1
+static int componentIndex(int components)
+{
+	switch (components) {
+	case 4: return 0;
+	case 1: return 1;
+	case 3: return 2;
+	default: return -1;
+	}
+}
+
+KernelFn findKernel(int srcBitDepth, int dstBitDepth, int components, int direction, bool masked, bool dither, bool luma, int variants)
+{
+	int comps = componentIndex(components);
+	if (comps < 0)
+		return 0;
+	if (direction < kDirBoth || direction > kDirColumns)
+		direction = kDirBoth;
+
+	if (srcBitDepth != dstBitDepth)
+	{
+		int promotion = promotionIndex(srcBitDepth, dstBitDepth);
+		if (promotion < 0)
+			return 0;
+		if (luma && components != 1)
+			return promotedLuma[promotion][components == 3 ? 1 : 0][dither ? 1 : 0][direction][masked ? 1 : 0];
+		return promotedKernels[promotion][comps][dither ? 1 : 0][direction][masked ? 1 : 0];
+	}
+
+	int depth = depthIndex(srcBitDepth);
+	if (depth < 0)
+		return 0;
+	if (srcBitDepth == kBitDepthHalf && halfHasF16C() && !(variants & kSoftHalf))
+	{
+		if (luma && components != 1)
+			return f16cLuma[components == 3 ? 1 : 0][dither ? 1 : 0][direction][masked ? 1 : 0];
+		return f16cKernels[comps][dither ? 1 : 0][direction][masked ? 1 : 0];
+	}
+	if (luma && components != 1)
+		return lumaKernels[depth][components == 3 ? 1 : 0][dither ? 1 : 0][direction][masked ? 1 : 0];
+	if (srcBitDepth == 32 && (variants & kUnkeyedFloat))
+		return unkeyedFloatKernels[comps][direction][masked ? 1 : 0];
+	return kernels[depth][comps][dither ? 1 : 0][direction][masked ? 1 : 0];
+}
+
+DiagnosticFn findDiagnostic(int srcBitDepth, int dstBitDepth, int components, int variants)
+{
+	int comps = componentIndex(components);
+	if (comps < 0)
+		return 0;
+	if (srcBitDepth != dstBitDepth)
+	{
+		int promotion = promotionIndex(srcBitDepth, dstBitDepth);
+		return promotion < 0 ? 0 : promotedDiagnostics[promotion][comps];
+	}
+	if (srcBitDepth == kBitDepthHalf && halfHasF16C() && !(variants & kSoftHalf))
+		return f16cDiagnostics[comps];
+	int depth = depthIndex(srcBitDepth);
+	return depth < 0 ? 0 : diagnostics[depth][comps];
+}
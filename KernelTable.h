@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+#include "DebandCore.h"
+#include "Processor.h"
+#include "Quantize.h"
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Every ProcessRGBA variant the plugin can run is compiled ahead of time in
+// KernelTable.cpp; render looks one up here once per frame instead of
+// testing depth, direction, mask and dither inside the pixel loops.
+
+// band lengths 2, 3-4, 5-8, ..., and everything over 2048
+const int kLengthBuckets = 12;
+
+// What a render measured, for the diagnostic outputs and the frame log.
+// Timings come from the kernel; band counts from the diagnostic pass.
+struct KernelStats {
+	std::vector<double> passSeconds;
+	std::vector<SliceTiming> sliceTimings;
+	long long rowBands, columnBands;
+	long long lengths[kLengthBuckets];
+};
+
+// What a kernel needs to render one window.  Pixels stay where the caller
+// has them: each image is its first row, the rect it covers and the bytes
+// from one row to the next, which may be negative for bottom-up buffers.
+// window must lie inside dst's rect; src and mask pixels outside their
+// rects count as missing.  A scratch is for one render at a time.
+struct KernelArgs {
+	const DebandHost *host;
+	void *src;
+	OfxRectI srcRect;
+	int srcRowBytes;
+	void *dst;
+	OfxRectI dstRect;
+	int dstRowBytes;
+	void *mask;
+	OfxRectI maskRect;
+	int maskRowBytes;
+	OfxRectI window;
+	int mode;
+	bool halfStep;			// move band ends at most half a quantization step
+	KernelStats *stats;		// timings go here if not 0
+	CostProfile *profile;	// the instance's, to balance threads by; may be 0
+	Quantization *quant;	// the instance's float source grid; may be 0
+	Scratch *scratch;		// kept from render to render, so they needn't allocate; may be 0
+};
+
+typedef void (*KernelFn)(const KernelArgs &args);
+typedef void (*DiagnosticFn)(const KernelArgs &args, int diagnostic, KernelStats &stats);
+
+// Choices findKernel otherwise makes by itself, as bits of its variants
+// argument.  They render the same: the tuner keeps whichever half
+// conversion is faster, and debandpipe --verify checks every one.
+enum KernelVariant {
+	kSoftHalf = 1,		// half kernels convert in software even where the CPU has F16C
+	kUnkeyedFloat = 2	// float kernels compare pixels as floats even on a grid
+};
+
+// srcBitDepth is 8, 16, 32 or kBitDepthHalf, components 4 (RGBA), 3 (RGB)
+// or 1 (alpha), direction a DebandDirection.  dstBitDepth is usually the
+// same; an 8 bit source can also render to 16 bit or float, and a 16 bit
+// one to float, with the same components.  The mask stays at the source's
+// depth.  luma debands only Y and leaves chroma alone; alpha images ignore
+// it.  variants is KernelVariant bits.  Returns 0 for a format we can't
+// render.
+KernelFn findKernel(int srcBitDepth, int dstBitDepth, int components, int direction, bool masked, bool dither, bool luma, int variants = 0);
+
+// Overwrites a rendered dst with a DebandDiagnostic view of it, and fills
+// in the band counts.  Takes the same formats as findKernel.
+DiagnosticFn findDiagnostic(int srcBitDepth, int dstBitDepth, int components, int variants = 0);
@@ -0,0 +1,124 @@
+#include "Metrics.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#ifdef _WIN32
+#  include <process.h>
+#  define getpid _getpid
+#else
+#  include <unistd.h>
+#endif
+
+// seconds between writes
+static const int kFlushSeconds = 10;
+
+Metrics metrics;
+
+static std::thread flusher;
+static std::mutex flushLock;
+static std::condition_variable flushWake;
+static bool stopping;
+static std::string metricsPath;
+
+static void writeCounter(FILE *f, const char *name, const char *help, long long value)
+{
+	fprintf(f, "# HELP %s %s\n# TYPE %s counter\n%s %lld\n", name, help, name, name, value);
+}
+
+static void writeSeconds(FILE *f, const char *name, const char *help, long long microseconds)
+{
+	fprintf(f, "# HELP %s %s\n# TYPE %s counter\n%s %.6f\n", name, help, name, name, microseconds / 1e6);
+}
+
+// Write to a temporary file and rename it over the real one, so a
+// collector never reads half a file.
+static void writeMetrics()
+{
+	std::string tmp = metricsPath + ".tmp";
+	FILE *f = fopen(tmp.c_str(), "w");
+	if (!f)
+		return;
+
+	writeCounter(f, "debander_renders_total", "Frames rendered.", metrics.renders);
+	writeCounter(f, "debander_render_failures_total", "Renders that returned an error.", metrics.failures);
+	writeCounter(f, "debander_aborts_total", "Renders the host aborted.", metrics.aborts);
+	writeSeconds(f, "debander_render_seconds_total", "Time spent in the kernels.", metrics.renderMicroseconds);
+	writeCounter(f, "debander_pixels_total", "Pixels rendered.", metrics.pixels);
+	writeCounter(f, "debander_bytes_read_total", "Source and mask bytes read.", metrics.bytesRead);
+	writeCounter(f, "debander_bytes_written_total", "Output bytes written.", metrics.bytesWritten);
+	writeCounter(f, "debander_degraded_frames_total", "Frames cut down to the row pass to meet the frame budget.", metrics.degradedFrames);
+	writeCounter(f, "debander_budget_overruns_total", "Frames that took longer than the frame budget anyway.", metrics.budgetOverruns);
+
+	fprintf(f, "# HELP debander_passes_total Passes run, by pass number.\n# TYPE debander_passes_total counter\n");
+	for (int i = 0; i < kMetricPasses; i++)
+		fprintf(f, "debander_passes_total{pass=\"%d\"} %lld\n", i, (long long)metrics.passes[i]);
+	fprintf(f, "# HELP debander_pass_seconds_total Time spent in each pass.\n# TYPE debander_pass_seconds_total counter\n");
+	for (int i = 0; i < kMetricPasses; i++)
+		fprintf(f, "debander_pass_seconds_total{pass=\"%d\"} %.6f\n", i, metrics.passMicroseconds[i] / 1e6);
+
+	fprintf(f, "# HELP debander_cache_hits_total Lookups that found what earlier frames kept.\n# TYPE debander_cache_hits_total counter\n");
+	fprintf(f, "debander_cache_hits_total{cache=\"cost_profile\"} %lld\n", (long long)metrics.profileHits);
+	fprintf(f, "debander_cache_hits_total{cache=\"grid\"} %lld\n", (long long)metrics.gridHits);
+	fprintf(f, "# HELP debander_cache_misses_total Lookups that had to start over.\n# TYPE debander_cache_misses_total counter\n");
+	fprintf(f, "debander_cache_misses_total{cache=\"cost_profile\"} %lld\n", (long long)metrics.profileMisses);
+	fprintf(f, "debander_cache_misses_total{cache=\"grid\"} %lld\n", (long long)metrics.gridMisses);
+
+	fclose(f);
+#ifdef _WIN32
+	remove(metricsPath.c_str());
+#endif
+	rename(tmp.c_str(), metricsPath.c_str());
+}
+
+// The lock only guards stopping, so it's let go while writing.
+static void flushLoop()
+{
+	std::unique_lock<std::mutex> l(flushLock);
+	while (!stopping) {
+		flushWake.wait_for(l, std::chrono::seconds(kFlushSeconds));
+		l.unlock();
+		writeMetrics();
+		l.lock();
+	}
+}
+
+void startMetrics()
+{
+	const char *env = getenv(METRICS_ENV);
+	if (!env || !*env || flusher.joinable())
+		return;
+
+	metricsPath = env;
+	size_t p = metricsPath.find("%p");
+	if (p != std::string::npos)
+		metricsPath.replace(p, 2, std::to_string((long long)getpid()));
+
+	stopping = false;
+	flusher = std::thread(flushLoop);
+}
+
+void stopMetrics()
+{
+	if (!flusher.joinable())
+		return;
+	{
+		std::lock_guard<std::mutex> l(flushLock);
+		stopping = true;
+	}
+	flushWake.notify_all();
+	flusher.join();
+}
+
+// A host may exit without unloading us, and destroying a thread that is
+// still running calls std::terminate, so the flusher is stopped on the
+// way out too.  Defined after everything stopMetrics() uses, so it goes
+// first.
+static struct StopMetricsAtExit {
+	~StopMetricsAtExit() { stopMetrics(); }
+} stopMetricsAtExit;
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Lifetime counters for this process, for watching throughput across a
+// farm.  If DEBANDER_METRICS names a file, a background thread rewrites it
+// in Prometheus text format every few seconds; "%p" in the name becomes
+// the process id, so several host processes on one node don't collide.
+
+// name of the variable with the file to write
+#define METRICS_ENV "DEBANDER_METRICS"
+
+// passes counted separately; later ones are added to the last
+const int kMetricPasses = 2;
+
+// Only ever added to.  Times are in microseconds.  Pass counts include
+// the tuner's timing runs.  Frames skipped as identity aren't counted:
+// isIdentity never skips one.
+struct Metrics {
+	std::atomic<long long> renders, failures, aborts;
+	std::atomic<long long> renderMicroseconds;
+	std::atomic<long long> pixels, bytesRead, bytesWritten;
+	std::atomic<long long> passes[kMetricPasses], passMicroseconds[kMetricPasses];
+	std::atomic<long long> profileHits, profileMisses;	// CostProfile::plan()
+	std::atomic<long long> gridHits, gridMisses;		// Quantization::find()
+	std::atomic<long long> degradedFrames, budgetOverruns;	// FrameBudget::render()
+};
+extern Metrics metrics;
+
+// add to a counter; nothing reads them in order, so relaxed is enough
+inline void count(std::atomic<long long> &counter, long long n = 1)
+{
+	counter.fetch_add(n, std::memory_order_relaxed);
+}
+
+// Start and stop the flush thread, if METRICS_ENV is set.  Stopping writes
+// the file one last time.
+void startMetrics();
+void stopMetrics();
@@ -0,0 +1,244 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <cmath>
+#include "ProcessRGBA.h"
+#include "KernelTable.h"
+
+
+
+// Replaces an already debanded dst with a picture of how it was debanded
+// (see DebandDiagnostic), and counts the bands it finds on the way.
+// Pass 0 measures column bands, pass 1 row bands and writes the output.
+template <class PIX, class MASK, int max, int isFloat, class DPIX = PIX>
+class ProcessDiagnostic : public ProcessRGBA<PIX, MASK, max, isFloat, kDirBoth, false, false, false, DPIX> {
+public:
+	typedef ProcessRGBA<PIX, MASK, max, isFloat, kDirBoth, false, false, false, DPIX> Base;
+	typedef typename Base::Colour Colour;
+	enum { N = Base::N };
+
+	ProcessDiagnostic(const DebandHost *host,
+		void *srcV, OfxRectI srcRect, int srcBytesPerLine,
+		void *dstV, OfxRectI dstRect, int dstBytesPerLine,
+		OfxRectI  window,
+		int diagnostic, KernelStats &stats)
+		: Base(host,
+			srcV, srcRect, srcBytesPerLine,
+			dstV, dstRect, dstBytesPerLine,
+			0, window, 0,
+			window)
+		, diagnostic(diagnostic)
+		, stats(stats)
+		, rowBands(0)
+		, columnBands(0)
+	{
+		for (int i = 0; i < kLengthBuckets; i++)
+			lengths[i] = 0;
+	}
+
+	int numPasses() { return 2; }
+	Processor::Slicing passSlicing(int pass) { return pass == 0 ? Processor::kSliceColumns : Processor::kSliceRows; }
+
+	void prepare(ScratchArena &frame)
+	{
+		const OfxRectI &window = this->window;
+		int w = window.x2 - window.x1, h = window.y2 - window.y1;
+		columnLength = frame.take<int>((size_t)w * h);
+
+		// Slices are whole rows or whole columns, so a pixel's cost is
+		// the sum of its row's share and its column's share.  The fused
+		// ramps pass is sliced by column only, so there the cost is one
+		// figure per column chunk, flat down the frame.
+		rowCost = frame.take<double>(h);
+		columnCost = frame.take<double>(w);
+		for (int y = 0; y < h; y++) rowCost[y] = 0;
+		for (int x = 0; x < w; x++) columnCost[x] = 0;
+		for (size_t i = 0; i < stats.sliceTimings.size(); i++)
+		{
+			const SliceTiming &t = stats.sliceTimings[i];
+			double area = (double)(t.rect.x2 - t.rect.x1) * (t.rect.y2 - t.rect.y1);
+			if (t.pass < 0 || area <= 0)
+				continue;
+			if (t.columns)
+				for (int x = t.rect.x1; x < t.rect.x2; x++)
+					columnCost[x - window.x1] += t.seconds / area;
+			else
+				for (int y = t.rect.y1; y < t.rect.y2; y++)
+					rowCost[y - window.y1] += t.seconds / area;
+		}
+		double maxRow = 0, maxColumn = 0;
+		for (int y = 0; y < h; y++) maxRow = Maximum(maxRow, rowCost[y]);
+		for (int x = 0; x < w; x++) maxColumn = Maximum(maxColumn, columnCost[x]);
+		maxCost = maxRow + maxColumn;
+	}
+
+	void doProcessing(OfxRectI window, ScratchArena & /*scratch*/)
+	{
+		if (Base::empty(window) || !Base::covers(this->srcRect, this->window) || !Base::covers(this->dstRect, this->window))
+			return;
+		if (this->pass == 0)
+			measureColumns(window);
+		else
+			drawRows(window);
+	}
+
+	// hand the band counts over once process() is done
+	void collect()
+	{
+		stats.rowBands = rowBands;
+		stats.columnBands = columnBands;
+		for (int i = 0; i < kLengthBuckets; i++)
+			stats.lengths[i] = lengths[i];
+	}
+
+protected:
+	int diagnostic;
+	KernelStats &stats;
+
+	int *columnLength;		// per window pixel, row major
+	double *rowCost, *columnCost;
+	double maxCost;
+
+	std::atomic<long long> rowBands, columnBands;
+	std::atomic<long long> lengths[kLengthBuckets];
+
+	static int bucket(int length)
+	{
+		int b = 0;
+		for (int l = 2; l < length && b < kLengthBuckets - 1; l *= 2)
+			b++;
+		return b;
+	}
+
+	inline size_t scratchIndex(int x, int y)
+	{
+		return (size_t)(y - this->window.y1) * (this->window.x2 - this->window.x1) + (x - this->window.x1);
+	}
+
+	// Colour for the output; one-channel images just get the grey, and
+	// alpha, if there is one, is opaque.
+	// Components are 0..1 whatever the depth.
+	static Colour shade(float r, float g, float b, float grey)
+	{
+		Colour c;
+		float scale = Base::dIsFloat ? 1.f : (float)Base::dMax;
+		if (N == 1)
+			c.c[0] = grey * scale;
+		else
+		{
+			c.c[0] = r * scale;
+			c.c[1] = g * scale;
+			c.c[2] = b * scale;
+			for (int k = 3; k < N; k++)
+				c.c[k] = scale;
+		}
+		return c;
+	}
+
+	// pass 0: every pixel's column band length
+	void measureColumns(OfxRectI window)
+	{
+		long long bands = 0;
+		long long hist[kLengthBuckets] = { 0 };
+
+		for (int x = window.x1; x < window.x2; x++)
+		{
+			if (this->cancelled())
+				break;
+
+			for (int y = window.y1; y < window.y2; )
+			{
+				PIX *p = Base::pixelAddress((PIX *)this->srcV, this->srcRect, x, y, this->srcBytesPerLine);
+				int yEnd = y + 1;
+				while (yEnd < window.y2 && Base::equals(p, Base::pixelAddress((PIX *)this->srcV, this->srcRect, x, yEnd, this->srcBytesPerLine)))
+					yEnd++;
+
+				int length = yEnd - y;
+				if (length > 1)
+				{
+					bands++;
+					hist[bucket(length)]++;
+				}
+				for (; y < yEnd; y++)
+					columnLength[scratchIndex(x, y)] = length;
+			}
+		}
+
+		columnBands += bands;
+		for (int i = 0; i < kLengthBuckets; i++)
+			lengths[i] += hist[i];
+	}
+
+	// pass 1: row band lengths, and draw the chosen view
+	void drawRows(OfxRectI window)
+	{
+		long long bands = 0;
+		long long hist[kLengthBuckets] = { 0 };
+		int w = this->window.x2 - this->window.x1;
+		int h = this->window.y2 - this->window.y1;
+		double logMax = std::log((double)Maximum(Maximum(w, h), 2));
+
+		for (int y = window.y1; y < window.y2; y++)
+		{
+			if (this->cancelled())
+				break;
+
+			PIX *pSrc = Base::pixelAddress((PIX *)this->srcV, this->srcRect, this->window.x1, y, this->srcBytesPerLine);
+			DPIX *pDst = Base::pixelAddress((DPIX *)this->dstV, this->dstRect, this->window.x1, y, this->dstBytesPerLine);
+
+			for (int xRun = 0; xRun < w; )
+			{
+				int xEnd = xRun + 1;
+				while (xEnd < w && Base::equals(&pSrc[xRun], &pSrc[xEnd]))
+					xEnd++;
+
+				int length = xEnd - xRun;
+				if (length > 1)
+				{
+					bands++;
+					hist[bucket(length)]++;
+				}
+
+				for (int i = xRun; i < xEnd; i++)
+				{
+					int x = this->window.x1 + i;
+					Colour c;
+					switch (diagnostic) {
+					case kDiagBandLength: {
+						int l = Maximum(length, columnLength[scratchIndex(x, y)]);
+						float v = l > 1 ? (float)(std::log((double)l) / logMax) : 0.f;
+						c = shade(v, v, v, v);
+						break;
+					}
+					case kDiagCost: {
+						float v = maxCost > 0 ? (float)((rowCost[y - this->window.y1] + columnCost[i]) / maxCost) : 0.f;
+						c = shade(v, 0.f, 1.f - v, v);
+						break;
+					}
+					default: {
+						// compared at the output's depth, as the kernel copied it
+						DPIX s;
+						Base::copyOut(s, pSrc[i]);
+						if (Base::equals(&pDst[i], &s))
+						{
+							c = Base::load(pSrc[i]);
+							for (int k = 0; k < N; k++)
+								c.c[k] *= (N == 1 || k < 3) ? 0.25f : 1.f;
+						}
+						else
+							c = shade(0.f, 1.f, 0.f, 1.f);
+						break;
+					}
+					}
+					Base::store(pDst[i], c);
+				}
+
+				xRun = xEnd;
+			}
+		}
+
+		rowBands += bands;
+		for (int i = 0; i < kLengthBuckets; i++)
+			lengths[i] += hist[i];
+	}
+};
@@ -0,0 +1,237 @@
+#pragma once
+#include "ProcessRGBA.h"
+
+
+
+// Rec. 709 luma weights
+const float kLumaR = 0.2126f;
+const float kLumaG = 0.7152f;
+const float kLumaB = 0.0722f;
+
+// Luma-only debanding, for RGBA pixels.  Split writes each window pixel's
+// Y to a float plane, which gets debanded like a one-channel image; merge
+// then adds each pixel's change in Y to R, G and B alike.  That moves Y by
+// just that much and leaves Cb and Cr as they were, so chroma passes
+// straight through at a quarter of the work of debanding every channel.
+// Y is in the output's range, as the channels load.
+//
+// Ramps along rows only, or columns only, never look from one row (or
+// column) to the next, so those run as one pass of strips instead: each
+// thread splits, debands and merges a strip at a time in its own scratch,
+// and the frame never needs planes of Y at all.  Ramps both ways, and
+// distance mode, follow bands across the whole frame, so they keep the
+// planes.
+template <class PIX, class MASK, int max, int isFloat, int DIR, bool MASKED, bool DITHER, class DPIX = PIX>
+class ProcessLuma : public ProcessRGBA<PIX, MASK, max, isFloat, kDirBoth, MASKED, DITHER, false, DPIX> {
+public:
+	typedef ProcessRGBA<PIX, MASK, max, isFloat, kDirBoth, MASKED, DITHER, false, DPIX> Base;
+	typedef typename Base::Colour Colour;
+	typedef typename Base::T T;
+	typedef typename Base::DT DT;
+	enum { N = Base::N };
+
+	enum Stage {
+		kSplit,		// luma = Y of src
+		kMerge,		// dst = src plus the change from luma to lumaOut
+		kStrips		// all three a strip at a time; DIR must be rows or columns
+	};
+
+	// luma and lumaOut hold one float per window pixel, row major; kStrips
+	// doesn't use them
+	ProcessLuma(const DebandHost *host,
+		void *srcV, OfxRectI srcRect, int srcBytesPerLine,
+		void *dstV, OfxRectI dstRect, int dstBytesPerLine,
+		void *maskV, OfxRectI maskRect, int maskBytesPerLine,
+		OfxRectI  window,
+		float *luma, float *lumaOut)
+		: Base(host,
+			srcV, srcRect, srcBytesPerLine,
+			dstV, dstRect, dstBytesPerLine,
+			maskV, maskRect, maskBytesPerLine,
+			window)
+		, stage(kSplit)
+		, lumaHalfStep(0)
+		, luma(luma)
+		, lumaOut(lumaOut)
+	{}
+
+	Stage stage;		// what process() does next
+	float lumaHalfStep;	// for debanding Y in strips, in Y's units
+
+	int numPasses() { return 1; }
+	Processor::Slicing passSlicing(int /*pass*/)
+	{
+		return stage == kStrips && DIR == kDirColumns ? Processor::kSliceColumns : Processor::kSliceRows;
+	}
+
+	void doProcessing(OfxRectI window, ScratchArena &scratch)
+	{
+		if (Base::empty(window) || !Base::covers(this->srcRect, this->window) || !Base::covers(this->dstRect, this->window))
+			return;
+
+		if (stage == kSplit)
+			split(window, luma, this->window);
+		else if (stage == kMerge)
+			merge(window, luma, lumaOut, this->window, scratch);
+		else
+			strips(window, scratch);
+	}
+
+protected:
+	float *luma, *lumaOut;
+
+	// Rows or columns per strip.  Narrower column strips read the source
+	// too sparsely to be any faster.
+	static const int kStrip = 64;
+
+	// row y of a plane that covers area, row major
+	static float *planeRow(float *plane, OfxRectI area, int x, int y)
+	{
+		return plane + (size_t)(y - area.y1) * (area.x2 - area.x1) + (x - area.x1);
+	}
+
+	// Half converts a pixel at a time, with F16C where there is one.  The
+	// rest load a channel at a time in the loops below, which have no
+	// branches or calls so the compiler can vectorise them.
+	static bool halfPixels()
+	{
+		return !std::is_integral<T>::value && !std::is_same<T, float>::value;
+	}
+
+	// Y of src over rect into luma, which covers area
+	void split(OfxRectI rect, float *luma, OfxRectI area)
+	{
+		int w = rect.x2 - rect.x1;
+		const float scale = Base::srcScale();
+		for (int y = rect.y1; y < rect.y2; y++)
+		{
+			if (this->cancelled())
+				break;
+
+			PIX *pSrc = Base::pixelAddress((PIX *)this->srcV, this->srcRect, rect.x1, y, this->srcBytesPerLine);
+			float *pY = planeRow(luma, area, rect.x1, y);
+			if (halfPixels())
+				for (int i = 0; i < w; i++)
+				{
+					Colour c = Base::load(pSrc[i]);
+					pY[i] = c.c[0] * kLumaR + c.c[1] * kLumaG + c.c[2] * kLumaB;
+				}
+			else
+			{
+				const T *t = (const T *)pSrc;
+				for (int i = 0; i < w; i++)
+					pY[i] = (float)t[i * N] * scale * kLumaR + (float)t[i * N + 1] * scale * kLumaG + (float)t[i * N + 2] * scale * kLumaB;
+			}
+		}
+	}
+
+	// dst over rect, from src and the change from luma to lumaOut, which
+	// both cover area.  Float outputs go a pixel at a time, since most
+	// pixels just copy.  Integer outputs work out what put() would, to the
+	// bit, a channel at a time, from rows of the change, dither and mask
+	// taken from the thread's scratch.
+	void merge(OfxRectI rect, float *luma, float *lumaOut, OfxRectI area, ScratchArena &scratch)
+	{
+		int w = rect.x2 - rect.x1;
+		const float scale = Base::srcScale();
+		float *d = scratch.take<float>(w);
+		float *bias = scratch.take<float>(w);
+		float *m = MASKED ? scratch.take<float>(w) : 0;
+		for (int y = rect.y1; y < rect.y2; y++)
+		{
+			if (this->cancelled())
+				break;
+
+			PIX *pSrc = Base::pixelAddress((PIX *)this->srcV, this->srcRect, rect.x1, y, this->srcBytesPerLine);
+			DPIX *pDst = Base::pixelAddress((DPIX *)this->dstV, this->dstRect, rect.x1, y, this->dstBytesPerLine);
+			const float *pY = planeRow(luma, area, rect.x1, y);
+			const float *pYOut = planeRow(lumaOut, area, rect.x1, y);
+			for (int i = 0; i < w; i++)
+				d[i] = pYOut[i] - pY[i];
+
+			if (Base::dIsFloat)
+			{
+				for (int i = 0; i < w; i++)
+				{
+					if (d[i] == 0)
+					{
+						// outside every band, as the kernel copied it
+						Base::copyOut(pDst[i], pSrc[i]);
+						continue;
+					}
+					Colour col = Base::load(pSrc[i]);
+					for (int k = 0; k < 3; k++)
+						col.c[k] += d[i];
+					this->put(&pDst[i], &pSrc[i], col, rect.x1 + i, y);
+				}
+				continue;
+			}
+
+			// Integers outside every band store as they'd copy, so every
+			// pixel goes the one way.  Clamped to 0..dMax, truncating is
+			// the floor store() takes.
+			if (MASKED)
+				for (int i = 0; i < w; i++)
+					m[i] = this->maskAt(rect.x1 + i, y);
+			for (int i = 0; i < w; i++)
+				bias[i] = DITHER ? Base::ditherAt(rect.x1 + i, y) : 0.5f;
+			const T *ts = (const T *)pSrc;
+			DT *td = (DT *)pDst;
+			for (int k = 0; k < N; k++)
+				for (int i = 0; i < w; i++)
+				{
+					float v = (float)ts[i * N + k] * scale;
+					if (k < 3)
+					{
+						float moved = v + d[i];
+						v = MASKED ? v + (moved - v) * m[i] : moved;
+					}
+					v += bias[i];
+					v = v < 0 ? 0.f : v > (float)Base::dMax ? (float)Base::dMax : v;
+					setChannel(td[i * N + k], v);
+				}
+		}
+	}
+
+	// split, deband and merge window kStrip rows or columns at a time
+	void strips(OfxRectI window, ScratchArena &scratch)
+	{
+		bool columns = DIR == kDirColumns;
+		int lo = columns ? window.x1 : window.y1;
+		int hi = columns ? window.x2 : window.y2;
+
+		for (int at = lo; at < hi; at += kStrip)
+		{
+			if (this->cancelled())
+				break;
+
+			OfxRectI strip = window;
+			if (columns)
+			{
+				strip.x1 = at;
+				strip.x2 = Minimum(at + kStrip, hi);
+			}
+			else
+			{
+				strip.y1 = at;
+				strip.y2 = Minimum(at + kStrip, hi);
+			}
+			int w = strip.x2 - strip.x1;
+			size_t n = (size_t)w * (strip.y2 - strip.y1);
+
+			// the last strip's buffers, and the kernel's, are done with
+			scratch.reset();
+			float *y = scratch.take<float>(n), *yOut = scratch.take<float>(n);
+
+			split(strip, y, strip);
+			ProcessRGBA<float, float, 1, 1, DIR> fred(this->host,
+				y, strip, w * (int)sizeof(float),
+				yOut, strip, w * (int)sizeof(float),
+				0, strip, 0,
+				strip);
+			fred.halfStep = lumaHalfStep;
+			fred.doProcessing(strip, scratch);
+			merge(strip, y, yOut, strip, scratch);
+		}
+	}
+};
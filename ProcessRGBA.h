@@ -1,40 +1,180 @@
 #pragma once
+#include <vector>
+#include <cstddef>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+#include "DebandCore.h"
 #include "Processor.h"
+#include "DistanceTransform.h"
+#include "Half.h"
 
-#define PROCESS_ROWS 1
-#define PROCESS_COLUMNS 1
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Pixel layouts: every pixel type is N channels of T, packed.  RGB and alpha
+// images are just three- and one-channel pixels, so they run through the
+// same kernels.
+
+template <class PIX> struct PixelLayout;
+template <> struct PixelLayout<OfxRGBAColourB> { typedef unsigned char T; enum { N = 4 }; };
+template <> struct PixelLayout<OfxRGBAColourS> { typedef unsigned short T; enum { N = 4 }; };
+template <bool F16C> struct PixelLayout<BasicRGBAColourH<F16C> > { typedef BasicHalf<F16C> T; enum { N = 4 }; };
+template <> struct PixelLayout<OfxRGBAColourF> { typedef float T; enum { N = 4 }; };
+template <> struct PixelLayout<OfxRGBColourB> { typedef unsigned char T; enum { N = 3 }; };
+template <> struct PixelLayout<OfxRGBColourS> { typedef unsigned short T; enum { N = 3 }; };
+template <bool F16C> struct PixelLayout<BasicRGBColourH<F16C> > { typedef BasicHalf<F16C> T; enum { N = 3 }; };
+template <> struct PixelLayout<OfxRGBColourF> { typedef float T; enum { N = 3 }; };
+template <> struct PixelLayout<unsigned char> { typedef unsigned char T; enum { N = 1 }; };
+template <> struct PixelLayout<unsigned short> { typedef unsigned short T; enum { N = 1 }; };
+template <bool F16C> struct PixelLayout<BasicHalf<F16C> > { typedef BasicHalf<F16C> T; enum { N = 1 }; };
+template <> struct PixelLayout<float> { typedef float T; enum { N = 1 }; };
+
+// The range a channel's values are stored in: integers 0..max, float
+// and half nominally 0..1.
+template <class T> struct ChannelRange { enum { max = 1, isFloat = 1 }; };
+template <> struct ChannelRange<unsigned char> { enum { max = 255, isFloat = 0 }; };
+template <> struct ChannelRange<unsigned short> { enum { max = 65535, isFloat = 0 }; };
+
+// Pixels get worked on as a Colour: N floats, whatever they're stored as.
+template <int N> struct Channels {
+	float c[N];
+};
+
+// widen a pixel to a Colour
+template <class PIX> inline
+void loadPixel(const PIX &p, Channels<PixelLayout<PIX>::N> &c)
+{
+	const typename PixelLayout<PIX>::T *t = (const typename PixelLayout<PIX>::T *)&p;
+	for (int k = 0; k < PixelLayout<PIX>::N; k++)
+		c.c[k] = (float)t[k];
+}
+
+template <bool F16C> inline
+void loadPixel(const BasicRGBAColourH<F16C> &p, Channels<4> &c)
+{
+	OfxRGBAColourF f = halfToFloat(p);
+	memcpy(c.c, &f, sizeof(c.c));
+}
+
+// narrow one channel; integer values must already be rounded and clamped
+inline void setChannel(unsigned char &t, float v) { t = (unsigned char)v; }
+inline void setChannel(unsigned short &t, float v) { t = (unsigned short)v; }
+template <bool F16C> inline void setChannel(BasicHalf<F16C> &t, float v) { t = v; }
+inline void setChannel(float &t, float v) { t = v; }
+
+// narrow a Colour to a float or half pixel
+template <class PIX> inline
+void storePixel(PIX &p, const Channels<PixelLayout<PIX>::N> &c)
+{
+	typename PixelLayout<PIX>::T *t = (typename PixelLayout<PIX>::T *)&p;
+	for (int k = 0; k < PixelLayout<PIX>::N; k++)
+		setChannel(t[k], c.c[k]);
+}
+
+template <bool F16C> inline
+void storePixel(BasicRGBAColourH<F16C> &p, const Channels<4> &c)
+{
+	OfxRGBAColourF f;
+	memcpy(&f, c.c, sizeof(c.c));
+	floatToHalf(p, f);
+}
 
 
 
 // template to do the RGBA processing
 // FULL IMPLEMENTATION GOES HERE -- C++ templates are done this way
-template <class PIX, class MASK, int max, int isFloat>
+//
+// Each combination of pixel type, direction (DebandDirection), mask and
+// dither is its own class, so none of them test for those in their loops.
+// KEYED kernels find bands by comparing pixels as integer keys (see same()).
+// KernelTable.cpp instantiates the lot.
+//
+// max and isFloat describe PIX, the source, and the mask, which is at the
+// source's depth.  DPIX, the output, may be deeper: then pixels load
+// scaled to the output's range, so ramps between 8-bit codes land on the
+// 16-bit or float values in between instead of rounding back to bands.
+template <class PIX, class MASK, int max, int isFloat, int DIR = kDirBoth, bool MASKED = false, bool DITHER = false, bool KEYED = false, class DPIX = PIX>
 class ProcessRGBA : public Processor {
 public:
-	ProcessRGBA(OfxImageEffectHandle handle,
+	typedef typename PixelLayout<PIX>::T T;
+	typedef typename PixelLayout<DPIX>::T DT;
+	enum { N = PixelLayout<PIX>::N };
+	typedef Channels<N> Colour;
+
+	enum {
+		dMax = ChannelRange<DT>::max,
+		dIsFloat = ChannelRange<DT>::isFloat
+	};
+	static_assert((int)PixelLayout<DPIX>::N == (int)N, "source and output need the same channels");
+	static_assert(!KEYED || sizeof(T) == sizeof(unsigned int), "only float pixels have keys");
+	typedef std::is_same<PIX, DPIX> SameDepth;
+
+	ProcessRGBA(const DebandHost *host,
 		void *srcV, OfxRectI srcRect, int srcBytesPerLine,
 		void *dstV, OfxRectI dstRect, int dstBytesPerLine,
 		void *maskV, OfxRectI maskRect, int maskBytesPerLine,
-		OfxRectI  window)
-		: Processor(handle,
+		OfxRectI  window,
+		int mode = kModeRamps)
+		: Processor(host,
 			srcV, srcRect, srcBytesPerLine,
 			dstV, dstRect, dstBytesPerLine,
 			maskV, maskRect, maskBytesPerLine,
 			window)
+		, halfStep(0)
+		, codes(isFloat ? 65535.f : 1.f)
+		, mode(mode)
+		, edges(0)
+		, seedRowDark(0)
+		, seedRowLight(0)
+	{}
+
+	template <class P> inline static
+	bool equals(const P *one, const P *two)
 	{
+		typedef typename PixelLayout<P>::T PT;
+		const PT *a = (const PT *)one;
+		const PT *b = (const PT *)two;
+		for (int k = 0; k < N; k++)
+			if (!(a[k] == b[k]))
+				return false;
+		return true;
 	}
 
+	// Band finding compares pixels through this.  On a quantized float
+	// source a pixel's bits are as good a key as its codes, so KEYED
+	// kernels compare them as integers, which the compiler does a whole
+	// pixel at a time.  The one pair of equal floats whose bits differ is
+	// -0 and +0, so a channel whose two sides are both zero counts as
+	// matching whatever its sign bits.  A NaN the grid's sample missed
+	// does match its own bits here, unlike as a float, so a run of one
+	// NaN pixel makes a band.
 	inline static
-	bool equals(PIX *one, PIX *two)
+	bool same(const PIX *one, const PIX *two)
+	{
+		if (!KEYED)
+			return equals(one, two);
+		const unsigned int *a = (const unsigned int *)one, *b = (const unsigned int *)two;
+		unsigned int diff = 0;
+		for (int k = 0; k < N; k++)
+			diff |= (a[k] ^ b[k]) & (0u - (unsigned int)(((a[k] | b[k]) << 1) != 0));
+		return diff == 0;
+	}
+
+	// Bit for bit the same, so anything worked out from one pixel holds
+	// for the other.  Duplicate rows and columns are found with this.
+	template <class P> inline static
+	bool identical(const P *one, const P *two, int n = 1)
 	{
-		return one->r == two->r && one->g == two->g && one->b == two->b && one->a == two->a;
+		return memcmp(one, two, n * sizeof(P)) == 0;
 	}
 
-	template <class T> inline static
-		T Clamp(T v, int min, int max)
+	template <class V> inline static
+		V Clamp(V v, int lo, int hi)
 	{
-		if (v < T(min)) return T(min);
-		if (v > T(max)) return T(max);
+		if (v < V(lo)) return V(lo);
+		if (v > V(hi)) return V(hi);
 		return v;
 	}
 
@@ -43,58 +183,314 @@ public:
 	// signum function, thanks to:
 	// https://stackoverflow.com/questions/1903954/is-there-a-standard-sign-function-signum-sgn-in-c-c
 	//
-	template <typename T> inline constexpr static
-		int signum(T x, std::false_type is_signed) {
-		return T(0) < x;
+	template <typename V> inline constexpr static
+		int signum(V x, std::false_type is_signed) {
+		return V(0) < x;
 	}
-	template <typename T> inline constexpr static
-		int signum(T x, std::true_type is_signed) {
-		return (T(0) < x) - (x < T(0));
+	template <typename V> inline constexpr static
+		int signum(V x, std::true_type is_signed) {
+		return (V(0) < x) - (x < V(0));
 	}
-	template <typename T> inline constexpr static
-		int signum(T x) {
-		return signum(x, std::is_signed<T>());
+	template <typename V> inline constexpr static
+		int signum(V x) {
+		return signum(x, std::is_signed<V>());
 	}
 	//
 	//=======================================================================
 
 
 
+	// what a source value is multiplied by to put it in the output's range
+	inline static constexpr
+	float srcScale()
+	{
+		return SameDepth::value ? 1.f : (float)dMax / max;
+	}
+
+	// a source pixel, in the output's range
+	inline static
+	Colour load(const PIX &p)
+	{
+		Colour c;
+		loadPixel(p, c);
+		if (!SameDepth::value)
+			for (int k = 0; k < N; k++)
+				c.c[k] *= srcScale();
+		return c;
+	}
+
+	// an output pixel, written earlier in the render
+	inline static
+	Colour loadOut(const DPIX &p)
+	{
+		Colour c;
+		loadPixel(p, c);
+		return c;
+	}
+
+	// Narrow a Colour back into a pixel.  Integer pixels get bias added
+	// before truncating: 0.5 rounds, a dither threshold dithers.
+	inline static
+	void store(DPIX &p, const Colour &c, float bias = 0.5f)
+	{
+		if (dIsFloat)
+			storePixel(p, c);
+		else
+		{
+			DT *t = (DT *)&p;
+			for (int k = 0; k < N; k++)
+				setChannel(t[k], Clamp(std::floor(c.c[k] + bias), 0, dMax));
+		}
+	}
+
+	// a source pixel copied through unchanged, bar the depth
+	inline static
+	void copyOut(DPIX &d, const PIX &s)
+	{
+		copyOut(d, s, SameDepth());
+	}
+	inline static
+	void copyOut(DPIX &d, const PIX &s, std::true_type /*same_depth*/)
+	{
+		d = (const DPIX &)s;
+	}
+	inline static
+	void copyOut(DPIX &d, const PIX &s, std::false_type /*same_depth*/)
+	{
+		// Most pixels come this way, so skip the Colour: 8 bit into 16 is
+		// exact, and integers into float just scale.
+		const T *ts = (const T *)&s;
+		DT *td = (DT *)&d;
+		if (!isFloat && !dIsFloat && dMax % max == 0)
+			for (int k = 0; k < N; k++)
+				td[k] = (DT)(ts[k] * (dMax / max));
+		else if (!isFloat && dIsFloat)
+			for (int k = 0; k < N; k++)
+				td[k] = (float)ts[k] * srcScale();
+		else
+			store(d, load(s));
+	}
+
+	// halfway between a band's end color and the pixel outside it
+	inline static
+	Colour mid(const Colour &out, const Colour &in)
+	{
+		Colour c;
+		for (int k = 0; k < N; k++)
+			c.c[k] = (out.c[k] + in.c[k]) * 0.5f;
+		return c;
+	}
+
+	// The color a band's end is pulled to.  Halfway to the pixel outside
+	// it debands if they're one step apart and deblocks if farther; with
+	// halfStep set it never moves more than that, so real edges stay put.
+	inline
+	Colour bandEnd(const Colour &out, const Colour &in)
+	{
+		Colour c = mid(out, in);
+		if (halfStep > 0)
+			for (int k = 0; k < N; k++)
+			{
+				if (c.c[k] > in.c[k] + halfStep) c.c[k] = in.c[k] + halfStep;
+				if (c.c[k] < in.c[k] - halfStep) c.c[k] = in.c[k] - halfStep;
+			}
+		return c;
+	}
+
+	// numer/denom of the way along a ramp from left to right
+	inline static
+	Colour ramp(const Colour &left, const Colour &right, int numer, int denom)
+	{
+		Colour c;
+		for (int k = 0; k < N; k++)
+			c.c[k] = left.c[k] * (denom - numer) / denom + right.c[k] * numer / denom;
+		return c;
+	}
+
+	// 4x4 Bayer matrix, as thresholds in [0, 1); repeats every kDitherPeriod
+	// pixels across and down
+	static const int kDitherPeriod = 4;
+	inline static
+	float ditherAt(int x, int y)
+	{
+		static const unsigned char bayer[4][4] = {
+			{  0,  8,  2, 10 },
+			{ 12,  4, 14,  6 },
+			{  3, 11,  1,  9 },
+			{ 15,  7, 13,  5 }
+		};
+		return (bayer[y & 3][x & 3] + 0.5f) / 16.f;
+	}
+
+	// mask value at a pixel, 0..1; no mask pixel means full effect
+	inline
+	float maskAt(int x, int y)
+	{
+		if (x < maskRect.x1 || x >= maskRect.x2 || y < maskRect.y1 || y >= maskRect.y2 || !maskV)
+			return 1.f;
+		MASK *pm = (MASK *)(((char *)maskV) + (ptrdiff_t)(y - maskRect.y1) * maskBytesPerLine);
+		pm += x - maskRect.x1;
+		return isFloat ? (float)*pm : (float)*pm / max;
+	}
+
+	// Write a finished pixel: mix it with the source by the mask, then
+	// dither and store.  Only the last pass of a render writes through here.
+	inline
+	void put(DPIX *pd, const PIX *ps, Colour c, int x, int y)
+	{
+		if (MASKED)
+		{
+			float m = maskAt(x, y);
+			Colour s = load(*ps);
+			for (int k = 0; k < N; k++)
+				c.c[k] = s.c[k] + (c.c[k] - s.c[k]) * m;
+		}
+		store(*pd, c, DITHER ? ditherAt(x, y) : 0.5f);
+	}
+
+
+
+	inline static
+	bool empty(const OfxRectI &r)
+	{
+		return r.x2 <= r.x1 || r.y2 <= r.y1;
+	}
+
+	// whether rect holds every pixel of win, which mustn't be empty
+	inline static
+	bool covers(const OfxRectI &rect, const OfxRectI &win)
+	{
+		return !empty(win) && win.x1 >= rect.x1 && win.x2 <= rect.x2 && win.y1 >= rect.y1 && win.y2 <= rect.y2;
+	}
+
+	// step a pixel pointer by whole rows; offsets are 64-bit so big frames don't wrap
+#define addrows_src(addr,n) (PIX *)(((char *)(addr)) + (ptrdiff_t)(n) * srcBytesPerLine)
+#define addrows_dst(addr,n) (DPIX *)(((char *)(addr)) + (ptrdiff_t)(n) * dstBytesPerLine)
+
 	// look up a pixel in the image, does bounds checking to see if it is in the image rectangle
-	static
-	PIX *pixelAddress(PIX *img, OfxRectI rect, int x, int y, int bytesPerLine)
+	template <class P> static
+	P *pixelAddress(P *img, OfxRectI rect, int x, int y, int bytesPerLine)
 	{
 		if (x < rect.x1 || x >= rect.x2 || y < rect.y1 || y >= rect.y2 || !img)
 			return 0;
-		PIX *pix = (PIX *)(((char *)img) + (y - rect.y1) * bytesPerLine);
+		P *pix = (P *)(((char *)img) + (ptrdiff_t)(y - rect.y1) * bytesPerLine);
 		pix += x - rect.x1;
 		return pix;
 	}
 
 
 
-	void doProcessing(OfxRectI window)
+	// Ramps: one pass, with rows and columns fused into the column
+	// walk.  Distance: for each class of bands (see bandClass), a column
+	// transform, then a row transform that fills that class's pixels; the
+	// first column pass also finds the contours.  Column passes are sliced
+	// by column so each thread sees whole columns.
+	int numPasses()
+	{
+		return mode == kModeDistance ? 2 * kClasses : 1;
+	}
+	Slicing passSlicing(int pass)
+	{
+		if (mode == kModeDistance)
+			return pass % 2 == 0 ? kSliceColumns : kSliceRows;
+		return DIR == kDirRows ? kSliceRows : kSliceColumns;
+	}
+
+	// Half a quantization step, in the units pixels load as, to limit band
+	// ends to (see bandEnd); 0 doesn't limit them.
+	float halfStep;
+
+	// Codes per unit of the source's samples, for bandClass: the grid's
+	// levels for float on one, else 65535; 1 for integers.
+	float codes;
+
+	void prepare(ScratchArena &frame)
+	{
+		if (mode == kModeDistance)
+		{
+			size_t n = (size_t)(window.x2 - window.x1) * (window.y2 - window.y1);
+			edges = frame.take<unsigned char>(n);
+			seedRowDark = frame.take<int>(n);
+			seedRowLight = frame.take<int>(n);
+		}
+	}
+
+	void doProcessing(OfxRectI window, ScratchArena &scratch)
 	{
 #ifdef _DEBUG
-		printf("  doProcessing( x=%d-%d  y=%d-%d)\n", window.x1, window.x2, window.y1, window.y2);
+		printf("  doProcessing(pass %d  x=%d-%d  y=%d-%d)\n", pass, window.x1, window.x2, window.y1, window.y2);
 #endif
 
+		// Every pass reads and writes through pixelAddress without checking
+		// for 0, so a window src or dst doesn't cover gets nothing done.
+		if (empty(window) || !covers(srcRect, this->window) || !covers(dstRect, this->window))
+			return;
+
+		if (mode == kModeDistance)
+		{
+			if (pass % 2 == 0)
+				distanceColumns(window, pass / 2, scratch);
+			else
+				distanceRows(window, pass / 2, scratch);
+		}
+		else if (passSlicing(pass) == kSliceRows)
+			processRows(window);
+		else
+			processColumns(window, scratch);
+	}
+
+protected:
+	int mode;
+
+	// Distance mode scratch, one entry per window pixel, row major.
+	// edges holds kEdge* flags and the pixel's class; seedRow* the
+	// window-relative row of the nearest contour pixel of the current
+	// class in the same column, or -1.
+	enum {
+		kEdgeDark = 1,		// borders a darker pixel (band's lower contour)
+		kEdgeLight = 2,		// borders a lighter pixel (band's upper contour)
+		kEdgeFlat = 4,		// has an equal neighbour, i.e. is part of a band
+		kClassShift = 3,
+		kClasses = N < 2 ? 2 : N < 4 ? 4 : 8,	// more than there are channels
+		kClassMask = (kClasses - 1) << kClassShift
+	};
+	unsigned char *edges;
+	int *seedRowDark, *seedRowLight;
+
+	void processRows(OfxRectI window)
+	{
 		PIX *src = (PIX *)srcV;
-		PIX *dst = (PIX *)dstV;
+		DPIX *dst = (DPIX *)dstV;
 
-#if PROCESS_ROWS
 		//=======================================================================
 		//
 		// PROCESS ROWS
 		//
 
+		// A row identical to the one above comes out the same, bar the
+		// mask and the dither pattern.  Unmasked, a row that is one period
+		// of the pattern into a run of identical rows is just copied.
+		int period = DITHER ? kDitherPeriod : 1;
+		int runStart = window.y1;	// first row of the run of identical rows
+
 		for (int y = window.y1; y < window.y2; y++) {
-			if (g.pEffectSuite->abort(instance))
+			if (cancelled())
 				break;
 
-			PIX *pDst = pixelAddress(dst, dstRect, window.x1, y, dstBytesPerLine);
+			DPIX *pDst = pixelAddress(dst, dstRect, window.x1, y, dstBytesPerLine);
 			PIX *pSrc = pixelAddress(src, srcRect, window.x1, y, srcBytesPerLine);
 
+			if (!MASKED)
+			{
+				if (y == window.y1 || !identical(pSrc, addrows_src(pSrc, -1), window.x2 - window.x1))
+					runStart = y;
+				if (y - period >= runStart)
+				{
+					memcpy(pDst, addrows_dst(pDst, -period), (window.x2 - window.x1) * sizeof(DPIX));
+					continue;
+				}
+			}
+
 			// need:
 			//   xLeft (1st pixel)
 			//   'start' color (left of xLeft)
@@ -111,10 +507,10 @@ public:
 				int xLeft = xMain;
 				for (; xLeft < wMain-1; xLeft++)
 				{
-					if (equals(&pSrc[xLeft], &pSrc[xLeft + 1]))
+					if (same(&pSrc[xLeft], &pSrc[xLeft + 1]))
 						break;
 					else
-						pDst[xLeft] = pSrc[xLeft];
+						copyOut(pDst[xLeft], pSrc[xLeft]);
 				}
 //TODO Copy the last pixel in the line
 
@@ -122,52 +518,29 @@ public:
 				int xRight = xLeft + 1;
 				for (; xRight < wMain; xRight++)
 				{
-					if (!equals(&pSrc[xLeft], &pSrc[xRight]))
+					if (!same(&pSrc[xLeft], &pSrc[xRight]))
 						break;
 				}
 
 				// Either way, xRight is one pixel too far
 				xRight--;
 
-				// This is deband mode: adjustments are limited to +/- 0.5 step.
 				// pColorLeft and -Right represent colors one pixel *outside* the band.
-				PIX pColorLeft = pSrc[xLeft];
+				Colour pColorLeft = load(pSrc[xLeft]);
 				if (xLeft > 0)
 				{
 					// look at pixel left of band to adjust start color
-					PIX *pOut = &pSrc[xLeft - 1];
-#if 0
-					// Since source image is float, I don't know how big a step is. :(
-					pColorLeft.r += signum(pOut->r - pColorLeft.r) * 0.5f;
-					pColorLeft.g += signum(pOut->g - pColorLeft.g) * 0.5f;
-					pColorLeft.b += signum(pOut->b - pColorLeft.b) * 0.5f;
-					pColorLeft.a += signum(pOut->a - pColorLeft.a) * 0.5f;
-#endif
-					// This will deband if color values are 1 'step' apart; deblock if farther.
-					pColorLeft.r = (pOut->r + pColorLeft.r) * 0.5f;
-					pColorLeft.g = (pOut->g + pColorLeft.g) * 0.5f;
-					pColorLeft.b = (pOut->b + pColorLeft.b) * 0.5f;
-					pColorLeft.a = (pOut->a + pColorLeft.a) * 0.5f;
+					// This will deband if color values are 1 'step' apart; deblock if farther,
+					// unless halfStep limits adjustments to +/- 0.5 step.
+					pColorLeft = bandEnd(load(pSrc[xLeft - 1]), pColorLeft);
 				}
 				else
 					; // Leave color as-is.
-				PIX pColorRight = pSrc[xRight];
+				Colour pColorRight = load(pSrc[xRight]);
 				if (xRight + 1 < wMain)
 				{
 					// look at pixel left of band to adjust start color
-					PIX *pOut = &pSrc[xRight + 1];
-#if 0
-					// Since source image is float, I don't know how big a step is. :(
-					pColorRight.r += signum(pOut->r - pColorRight.r) * 0.5f;
-					pColorRight.g += signum(pOut->g - pColorRight.g) * 0.5f;
-					pColorRight.b += signum(pOut->b - pColorRight.b) * 0.5f;
-					pColorRight.a += signum(pOut->a - pColorRight.a) * 0.5f;
-#endif
-					// This will deband if color values are 1 'step' apart; deblock if farther.
-					pColorRight.r = (pOut->r + pColorRight.r) * 0.5f;
-					pColorRight.g = (pOut->g + pColorRight.g) * 0.5f;
-					pColorRight.b = (pOut->b + pColorRight.b) * 0.5f;
-					pColorRight.a = (pOut->a + pColorRight.a) * 0.5f;
+					pColorRight = bandEnd(load(pSrc[xRight + 1]), pColorRight);
 				}
 				else
 					; // Leave color as-is.
@@ -190,128 +563,545 @@ public:
 					// numer ranges [1 .. (size-1)]
 					int numer = (ix - xLeft) + 1;
 
-					//pDst[ix] = pSrc[ix];
-					//pDst[ix].r = (float)max * (denom - numer) / denom;
-					pDst[ix].r = pColorLeft.r * (denom - numer) / denom + pColorRight.r * numer / denom;
-					pDst[ix].g = pColorLeft.g * (denom - numer) / denom + pColorRight.g * numer / denom;
-					pDst[ix].b = pColorLeft.b * (denom - numer) / denom + pColorRight.b * numer / denom;
-					pDst[ix].a = pColorLeft.a * (denom - numer) / denom + pColorRight.a * numer / denom;
+					put(&pDst[ix], &pSrc[ix], ramp(pColorLeft, pColorRight, numer, denom), window.x1 + ix, y);
 				}
 
 				// Skip main loop past this band.
 				xMain = xRight;
 			}
 		}
-#endif PROCESS_ROWS
-
-
+	}
 
-#if PROCESS_COLUMNS
+	// The column pass streams down the window a row at a time, so src is
+	// read in memory order whatever the image height.  The only state
+	// carried from row to row is where each column's open band started;
+	// a band is written out as soon as the row below it differs.
+	//
+	// With both directions the row ramps are worked out on the same walk,
+	// into a ring of the last kPendingRows rows, and averaged in when the
+	// column band closes.  Rows falling out of the ring while their band
+	// is still open get parked in dst, so each dst pixel is written once
+	// unless its column band is taller than the ring.
+	//
+	// The walk also keeps track of duplicates, which is all a gradient is
+	// made of: a row identical to the one above has the same row ramps,
+	// and columns identical to their left neighbour so far have the same
+	// bands, so both get copied rather than worked out again.
+	void processColumns(OfxRectI window, ScratchArena &scratch)
+	{
 		//=======================================================================
 		//
 		// PROCESS COLUMNS
 		//
-#define addrows_src(addr,n) (PIX *)(((char *)(addr)) + (n) * srcBytesPerLine)
-#define addrows_dst(addr,n) (PIX *)(((char *)(addr)) + (n) * dstBytesPerLine)
+		PIX *src = (PIX *)srcV;
+
+		int wMain = window.x2 - window.x1;
+		int hMain = window.y2 - window.y1;  //actual num pixels to process
+		if (wMain <= 0 || hMain <= 0)
+			return;
+
+		// band tops, relative to window.y1, one per column in this slice
+		int *yTop = scratch.take<int>(wMain);
+		for (int i = 0; i < wMain; i++)
+			yTop[i] = 0;
 
-		for (int x = window.x1; x < window.x2; x++)
+		PendingRows pending;
+		PendingRows *pRows = 0;
+		if (DIR == kDirBoth)
 		{
-			if (g.pEffectSuite->abort(instance))
-				break;
+			pending.pix = scratch.take<DPIX>((size_t)kPendingRows * wMain);
+			pending.width = wMain;
+			pending.first = 0;
+			pRows = &pending;
+			rowRamps(window, window.y1, pending.row(0), pending.readFrom, pending.readTo);
+		}
+
+		PIX *pSrcPrev = pixelAddress(src, srcRect, window.x1, window.y1, srcBytesPerLine);
+
+		ColumnRuns runs;
+		runs.first = scratch.take<int>(wMain);
+		runs.joined = 0;
+		for (int i = 0; i < wMain; i++)
+		{
+			runs.first[i] = i > 0 && identical(&pSrcPrev[i], &pSrcPrev[i - 1]) ? runs.first[i - 1] : i;
+			if (runs.first[i] != i)
+				runs.joined++;
+		}
+		runs.ramp = scratch.take<Colour>(hMain);
 
-			PIX *pDst = pixelAddress(dst, dstRect, x, window.y1, dstBytesPerLine);
-			PIX *pSrc = pixelAddress(src, srcRect, x, window.y1, srcBytesPerLine);
+		for (int yMain = 1; yMain < hMain; yMain++)
+		{
+			if (yMain % kStripRows == 0 && cancelled())
+				return;
 
-			int hMain = window.y2 - window.y1;  //actual num pixels to process
-			for (int yMain = 0; yMain < hMain; yMain++)
+			if (DIR == kDirBoth)
 			{
-				// don't forget -- pSrc already points to pixel at window.y1
+				// make room for this row, parking the oldest if it's still needed
+				if (yMain >= kPendingRows)
+				{
+					int yOld = yMain - kPendingRows;
+					DPIX *pOld = pending.row(yOld);
+					DPIX *pDst = pixelAddress((DPIX *)dstV, dstRect, window.x1, window.y1 + yOld, dstBytesPerLine);
+					for (int i = 0; i < wMain; i++)
+						if (yTop[i] <= yOld)
+							pDst[i] = pOld[i];
+					pending.first = yOld + 1;
+				}
 
-				// Hunt for start of band
-				int yTop = yMain;
-				for (; yTop < hMain - 1; yTop++)
+				// the same pixels as last row, over all the row ramps read, make the same ramps
+				PIX *pRow = pixelAddress(src, srcRect, this->window.x1, window.y1 + yMain, srcBytesPerLine);
+				PIX *pAbove = addrows_src(pRow, -1);
+				if (identical(&pRow[pending.readFrom], &pAbove[pending.readFrom], pending.readTo - pending.readFrom))
+					memcpy(pending.row(yMain), pending.row(yMain - 1), wMain * sizeof(DPIX));
+				else
+					rowRamps(window, window.y1 + yMain, pending.row(yMain), pending.readFrom, pending.readTo);
+			}
+
+			PIX *pSrcRow = addrows_src(pSrcPrev, 1);
+
+			// Bands closing on this row take in this row's pixels, so the
+			// runs must cover it before any band is written.
+			for (int i = 1; runs.joined > 0 && i < wMain; i++)
+			{
+				if (runs.first[i] == i)
+					continue;
+				if (identical(&pSrcRow[i], &pSrcRow[i - 1]))
+					runs.first[i] = runs.first[i - 1];
+				else
 				{
-					if (equals(addrows_src(pSrc, yTop), addrows_src(pSrc, yTop + 1)))
-						break;
-					else
-						*addrows_dst(pDst, yTop) = *addrows_src(pSrc, yTop);
+					runs.first[i] = i;
+					runs.joined--;
 				}
+			}
 
-				// Hunt for end of band
-				int yBot = yTop + 1;
-				for (; yBot < hMain; yBot++)
+			DPIX *pDstPrev = pixelAddress((DPIX *)dstV, dstRect, window.x1, window.y1 + yMain - 1, dstBytesPerLine);
+			for (int i = 0; i < wMain; i++)
+			{
+				if (!same(&pSrcPrev[i], &pSrcRow[i]))
 				{
-					if (!equals(addrows_src(pSrc, yTop), addrows_src(pSrc, yBot)))
-						break;
+					// one-pixel bands are common in detail; copy them without the call
+					if (yTop[i] == yMain - 1)
+						copyOut(pDstPrev[i], pSrcPrev[i]);
+					else
+						closeColumnBand(window, i, yTop[i], yMain - 1, pRows, runs);
+					yTop[i] = yMain;
 				}
+			}
+			pSrcPrev = pSrcRow;
+		}
+
+		// whatever is still open runs off the bottom of the window
+		for (int i = 0; i < wMain; i++)
+			closeColumnBand(window, i, yTop[i], hMain - 1, pRows, runs);
+	}
+
+	// rows between abort checks in the streamed passes
+	static const int kStripRows = 64;
+
+	// rows of row-ramp results kept per thread by the fused pass
+	static const int kPendingRows = 64;
+
+	// ring of row-ramp results for one column slice, indexed by window-relative row
+	struct PendingRows {
+		DPIX *pix;
+		int width;
+		int first;		// oldest row still in the ring; older ones are parked in dst
+		int readFrom, readTo;	// the src columns the newest row's ramps came from
+		DPIX *row(int y) { return &pix[(size_t)(y % kPendingRows) * width]; }
+	};
+
+	// Runs of columns in one column slice that have been identical so far.
+	// The first column of a run leaves its column ramps in ramp for the
+	// rest, whose bands close on the same row.
+	struct ColumnRuns {
+		int *first;		// per column, the first of its run
+		int joined;		// columns that aren't the first of theirs
+		Colour *ramp;	// by window-relative row
+	};
+
+	// The row pass's result for one row, just for the columns in slice.
+	// Bands are the same maximal runs processRows finds, so a band that
+	// crosses the slice edge is followed out to its ends in the full window.
+	// readFrom..readTo-1 are set to the window-relative columns it looked at.
+	void rowRamps(const OfxRectI &slice, int y, DPIX *out, int &readFrom, int &readTo)
+	{
+		PIX *pSrc = pixelAddress((PIX *)srcV, srcRect, window.x1, y, srcBytesPerLine);
+		int wMain = window.x2 - window.x1;
+		int x1 = slice.x1 - window.x1;
+		int x2 = slice.x2 - window.x1;
+		readFrom = readTo = x1;
+		if (!pSrc || x2 <= x1)
+			return;
 
-				// Either way, yBot is one pixel too far
-				yBot--;
+		// back up to the start of the band under the slice's first column
+		int xLeft = x1;
+		while (xLeft > 0 && same(&pSrc[xLeft - 1], &pSrc[xLeft]))
+			xLeft--;
+		readFrom = Maximum(xLeft - 1, 0);
+		readTo = x2;
 
+		while (xLeft < x2)
+		{
+			int xRight = xLeft;
+			while (xRight + 1 < wMain && same(&pSrc[xLeft], &pSrc[xRight + 1]))
+				xRight++;
+
+			if (xLeft == xRight && xRight < wMain - 1)
+				copyOut(out[xLeft - x1], pSrc[xLeft]);
+			else
+			{
 				// See row mode for docs and notes.
-				PIX pColorTop = *addrows_src(pSrc, yTop);
-				if (yTop > 0)
+				Colour pColorLeft = load(pSrc[xLeft]);
+				if (xLeft > 0)
+					pColorLeft = bandEnd(load(pSrc[xLeft - 1]), pColorLeft);
+				Colour pColorRight = load(pSrc[xRight]);
+				if (xRight + 1 < wMain)
+					pColorRight = bandEnd(load(pSrc[xRight + 1]), pColorRight);
+
+				int denom = (xRight - xLeft + 1) + 1;
+				for (int ix = Maximum(xLeft, x1); ix <= xRight && ix < x2; ix++)
+					store(out[ix - x1], ramp(pColorLeft, pColorRight, (ix - xLeft) + 1, denom));
+			}
+
+			readTo = Minimum(xRight + 2, wMain);
+			xLeft = xRight + 1;
+		}
+	}
+
+	// Write out one column band, rows yTop..yBot relative to window.y1.
+	// Single pixels are copied, except on the last row, which always gets
+	// blended -- the same as the original hunt-for-band loop did.
+	// With both directions, pending holds the row ramps to average in.
+	//
+	// A column in a run of identical ones takes its column ramps from the
+	// run's first column.  Unmasked, one a dither period into the run is
+	// copied outright, wherever its row ramps match too.
+	void closeColumnBand(const OfxRectI &window, int i, int yTop, int yBot, PendingRows *pending, ColumnRuns &runs)
+	{
+		int hMain = window.y2 - window.y1;
+		PIX *pSrc = pixelAddress((PIX *)srcV, srcRect, window.x1 + i, window.y1, srcBytesPerLine);
+		DPIX *pDst = pixelAddress((DPIX *)dstV, dstRect, window.x1 + i, window.y1, dstBytesPerLine);
+		if (!pSrc || !pDst || yTop > yBot)
+			return;
+
+		if (yTop == yBot && yBot < hMain - 1)
+		{
+			copyOut(*addrows_dst(pDst, yTop), *addrows_src(pSrc, yTop));
+			return;
+		}
+
+		int period = DITHER ? kDitherPeriod : 1;
+		int first = runs.first[i];
+		bool keep = first == i && i + 1 < window.x2 - window.x1 && runs.first[i + 1] != i + 1;
+
+		// See row mode for docs and notes.
+		Colour pColorTop = load(*addrows_src(pSrc, yTop));
+		if (yTop > 0)
+		{
+			// look at pixel above band to adjust start color
+			// This will deband if color values are 1 'step' apart; deblock if farther.
+			pColorTop = bandEnd(load(*addrows_src(pSrc, yTop - 1)), pColorTop);
+		}
+		else
+			; // Leave color as-is.
+		Colour pColorBot = load(*addrows_src(pSrc, yBot));
+		if (yBot + 1 < hMain)
+		{
+			// look at pixel below band to adjust end color
+			// This will deband if color values are 1 'step' apart; deblock if farther.
+			pColorBot = bandEnd(load(*addrows_src(pSrc, yBot + 1)), pColorBot);
+		}
+		else
+			; // Leave color as-is.
+
+		for (int iy = yTop; iy <= yBot; iy++)
+		{
+			// denom is one more than band size
+			int denom = (yBot - yTop + 1) + 1;
+			// numer ranges [1 .. (size-1)]
+			int numer = (iy - yTop) + 1;
+
+			DPIX *pd = addrows_dst(pDst, iy);
+			if (!MASKED && i - period >= first
+				&& (DIR == kDirColumns || (iy >= pending->first && identical(&pending->row(iy)[i], &pending->row(iy)[i - period]))))
+			{
+				*pd = pd[-period];
+				continue;
+			}
+
+			Colour c;
+			if (first != i)
+				c = runs.ramp[iy];
+			else
+			{
+				c = ramp(pColorTop, pColorBot, numer, denom);
+				if (keep)
+					runs.ramp[iy] = c;
+			}
+
+			if (DIR == kDirBoth)
+			{
+				// average color with row mode result
+				Colour d = loadOut(iy >= pending->first ? pending->row(iy)[i] : *pd);
+				for (int k = 0; k < N; k++)
 				{
-					// look at pixel above band to adjust start color
-					PIX *pOut = addrows_src(pSrc, yTop - 1);
-					// This will deband if color values are 1 'step' apart; deblock if farther.
-					pColorTop.r = (pOut->r + pColorTop.r) * 0.5f;
-					pColorTop.g = (pOut->g + pColorTop.g) * 0.5f;
-					pColorTop.b = (pOut->b + pColorTop.b) * 0.5f;
-					pColorTop.a = (pOut->a + pColorTop.a) * 0.5f;
+					d.c[k] += c.c[k];
+					d.c[k] /= 2.f;
 				}
-				else
-					; // Leave color as-is.
-				PIX pColorBot = *addrows_src(pSrc, yBot);
-				if (yBot + 1 < hMain)
+				c = d;
+			}
+
+			put(pd, addrows_src(pSrc, iy), c, window.x1 + i, window.y1 + iy);
+		}
+	}
+
+
+
+	//=======================================================================
+	//
+	// DISTANCE MODE
+	//
+	// Each band pixel is interpolated between its band's lower and upper
+	// contours, weighted by its Euclidean distance to each.  The distances
+	// come from an exact separable transform over the whole window, seeded
+	// from contour pixels.
+	//
+	// A band's own contours are what count, but a lighter neighbour's
+	// lower contour lies right along its upper one.  So bands are split
+	// into classes by brightness, neighbours a step apart landing in
+	// different classes, and each class gets its own transform seeded only
+	// from its own contours.  A nearest seed that still turns out to be
+	// another band's, one the same class further off, counts as no contour
+	// on that side.
+	//
+
+	// rough brightness; only used to tell which side of a contour is darker
+	inline static
+	double brightness(const PIX *p)
+	{
+		const T *t = (const T *)p;
+		double b = 0;
+		for (int k = 0; k < N; k++)
+			b += (float)t[k];
+		return b;
+	}
+
+	// Brightness in codes (see codes), modulo the number of classes.
+	// Neighbouring bands a step apart in some or all channels have sums 1
+	// to N codes apart, fewer than there are classes, so always differ;
+	// ones further apart may share a class, and the check on the nearest
+	// seed's colour catches those.
+	inline
+	int bandClass(const PIX *p)
+	{
+		double m = std::fmod(std::floor(brightness(p) * codes + 0.5), (double)kClasses);
+		if (m < 0)
+			m += kClasses;
+		return m >= 0 && m < kClasses ? (int)m : 0;
+	}
+
+	// window-relative index into the scratch buffers
+	inline size_t scratchIndex(int x, int y)
+	{
+		return (size_t)(y - this->window.y1) * (this->window.x2 - this->window.x1) + (x - this->window.x1);
+	}
+
+	// neighbouring pixel, or 0 if it's outside the window
+	PIX *neighbour(int x, int y)
+	{
+		if (x < this->window.x1 || x >= this->window.x2 || y < this->window.y1 || y >= this->window.y2)
+			return 0;
+		return pixelAddress((PIX *)srcV, srcRect, x, y, srcBytesPerLine);
+	}
+
+	// The color a contour is pulled to: halfway between the seed pixel and
+	// the neighbour across the contour closest to it in brightness.
+	Colour contourColor(int x, int y, bool darkSide)
+	{
+		static const int dx[4] = { -1, 1, 0, 0 };
+		static const int dy[4] = { 0, 0, -1, 1 };
+
+		PIX *pIn = neighbour(x, y);
+		double bIn = brightness(pIn);
+		PIX *pOut = 0;
+		double bOut = 0;
+		for (int i = 0; i < 4; i++)
+		{
+			PIX *p = neighbour(x + dx[i], y + dy[i]);
+			if (!p)
+				continue;
+			double b = brightness(p);
+			if (darkSide ? (b < bIn && (!pOut || b > bOut)) : (b > bIn && (!pOut || b < bOut)))
+			{
+				pOut = p;
+				bOut = b;
+			}
+		}
+
+		Colour c = load(*pIn);
+		if (pOut)
+			c = bandEnd(load(*pOut), c);
+		return c;
+	}
+
+	// Even passes: find, per column, the nearest contour pixel of each
+	// kind in class c, over the whole column.  The first also classifies
+	// every pixel.
+	void distanceColumns(OfxRectI window, int c, ScratchArena &scratch)
+	{
+		static const int dx[4] = { -1, 1, 0, 0 };
+		static const int dy[4] = { 0, 0, -1, 1 };
+
+		int w = window.x2 - window.x1, h = window.y2 - window.y1;
+		ptrdiff_t stride = this->window.x2 - this->window.x1;
+		size_t o = scratchIndex(window.x1, window.y1);
+
+		if (c == 0)
+		{
+			for (int y = window.y1; y < window.y2; y++)
+			{
+				if ((y - window.y1) % kStripRows == 0 && cancelled())
+					return;
+
+				for (int x = window.x1; x < window.x2; x++)
 				{
-					// look at pixel left of band to adjust start color
-					PIX *pOut = addrows_src(pSrc, yBot + 1);
-					// This will deband if color values are 1 'step' apart; deblock if farther.
-					pColorBot.r = (pOut->r + pColorBot.r) * 0.5f;
-					pColorBot.g = (pOut->g + pColorBot.g) * 0.5f;
-					pColorBot.b = (pOut->b + pColorBot.b) * 0.5f;
-					pColorBot.a = (pOut->a + pColorBot.a) * 0.5f;
+					PIX *p = neighbour(x, y);
+					double b = brightness(p);
+					unsigned char flags = (unsigned char)(bandClass(p) << kClassShift);
+					for (int i = 0; i < 4; i++)
+					{
+						PIX *q = neighbour(x + dx[i], y + dy[i]);
+						if (!q)
+							continue;
+						if (same(p, q))
+							flags |= kEdgeFlat;
+						else if (brightness(q) < b)
+							flags |= kEdgeDark;
+						else if (brightness(q) > b)
+							flags |= kEdgeLight;
+					}
+					edges[scratchIndex(x, y)] = flags;
 				}
-				else
-					; // Leave color as-is.
+			}
+		}
+		if (cancelled())
+			return;
+
+		int *last = scratch.take<int>(w);
+		unsigned char cls = (unsigned char)(c << kClassShift);
+		nearestSeedColumns(&edges[o], w, h, stride, kEdgeDark | kClassMask, kEdgeDark | cls, &seedRowDark[o], last);
+		nearestSeedColumns(&edges[o], w, h, stride, kEdgeLight | kClassMask, kEdgeLight | cls, &seedRowLight[o], last);
+	}
+
+	// Odd passes: finish class c's transforms along each row, then
+	// interpolate every band pixel of that class between its two contour
+	// colors.  Every pixel belongs to one class, so gets written once.
+	void distanceRows(OfxRectI window, int c, ScratchArena &scratch)
+	{
+		DPIX *dst = (DPIX *)dstV;
 
-				for (int iy = yTop; iy <= yBot; iy++)
+		int x1 = this->window.x1, w = this->window.x2 - x1;
+		double *f = scratch.take<double>(w), *d2Dark = scratch.take<double>(w), *d2Light = scratch.take<double>(w);
+		double *z = scratch.take<double>(w + 1);
+		int *nearDark = scratch.take<int>(w), *nearLight = scratch.take<int>(w), *v = scratch.take<int>(w);
+
+		for (int y = window.y1; y < window.y2; y++)
+		{
+			if (cancelled())
+				break;
+
+			PIX *pSrc = pixelAddress((PIX *)srcV, srcRect, x1, y, srcBytesPerLine);
+			DPIX *pDst = pixelAddress(dst, dstRect, x1, y, dstBytesPerLine);
+			const unsigned char *e = &edges[scratchIndex(x1, y)];
+
+			// the transforms only if some band pixel of the class needs them
+			bool bands = false;
+			for (int i = 0; i < w && !bands; i++)
+				bands = (e[i] & (kClassMask | kEdgeFlat)) == ((c << kClassShift) | kEdgeFlat);
+			if (bands)
+			{
+				rowTransform(y, seedRowDark, f, nearDark, d2Dark, v, z);
+				rowTransform(y, seedRowLight, f, nearLight, d2Light, v, z);
+			}
+
+			for (int i = 0; i < w; i++)
+			{
+				if ((e[i] & kClassMask) >> kClassShift != c)
+					continue;
+				int x = x1 + i;
+				if (!(e[i] & kEdgeFlat))
 				{
-					// denom is one more than band size
-					int denom = (yBot - yTop + 1) + 1;
-					// numer ranges [1 .. (size-1)]
-					int numer = (iy - yTop) + 1;
-
-					PIX *ps = addrows_src(pSrc, iy);
-					PIX *pd = addrows_dst(pDst, iy);
-
-					//pDst[ix] = pSrc[ix];
-					//pDst[ix].r = (float)max * (denom - numer) / denom;
-#if PROCESS_ROWS
-					// average color with row mode result
-					pd->r += pColorTop.r * (denom - numer) / denom + pColorBot.r * numer / denom;
-					pd->g += pColorTop.g * (denom - numer) / denom + pColorBot.g * numer / denom;
-					pd->b += pColorTop.b * (denom - numer) / denom + pColorBot.b * numer / denom;
-					pd->a += pColorTop.a * (denom - numer) / denom + pColorBot.a * numer / denom;
-					pd->r /= 2.f;
-					pd->g /= 2.f;
-					pd->b /= 2.f;
-					pd->a /= 2.f;
-#else
-					// dump color into dest image
-					pd->r = pColorTop.r * (denom - numer) / denom + pColorBot.r * numer / denom;
-					pd->g = pColorTop.g * (denom - numer) / denom + pColorBot.g * numer / denom;
-					pd->b = pColorTop.b * (denom - numer) / denom + pColorBot.b * numer / denom;
-					pd->a = pColorTop.a * (denom - numer) / denom + pColorBot.a * numer / denom;
-#endif
+					copyOut(pDst[i], pSrc[i]);
+					continue;
 				}
 
-				// Skip main loop past this band.
-				yMain = yBot;
+				// the nearest contours, if they're this band's
+				int yd = 0, yl = 0;
+				bool hasDark = nearDark[i] >= 0, hasLight = nearLight[i] >= 0;
+				if (hasDark)
+				{
+					yd = seedY(seedRowDark, nearDark[i], y);
+					hasDark = same(neighbour(x1 + nearDark[i], yd), &pSrc[i]);
+				}
+				if (hasLight)
+				{
+					yl = seedY(seedRowLight, nearLight[i], y);
+					hasLight = same(neighbour(x1 + nearLight[i], yl), &pSrc[i]);
+				}
+				if (!hasDark && !hasLight)
+				{
+					// a band with no contours, e.g. flat to the window edges
+					copyOut(pDst[i], pSrc[i]);
+					continue;
+				}
+
+				// Distances run to the pixel across the contour, matching
+				// the ramp modes.  A missing side falls back to the other
+				// one, which flattens plateaus just like a 1-D ramp would.
+				Colour cDark, cLight;
+				float t;
+				if (hasDark && hasLight)
+				{
+					cDark = contourColor(x1 + nearDark[i], yd, true);
+					cLight = contourColor(x1 + nearLight[i], yl, false);
+					double dDark = std::sqrt(d2Dark[i]) + 1;
+					double dLight = std::sqrt(d2Light[i]) + 1;
+					t = (float)(dDark / (dDark + dLight));
+				}
+				else if (hasDark)
+				{
+					cDark = cLight = contourColor(x1 + nearDark[i], yd, true);
+					t = 0;
+				}
+				else
+				{
+					cDark = cLight = contourColor(x1 + nearLight[i], yl, false);
+					t = 0;
+				}
+
+				Colour col;
+				for (int k = 0; k < N; k++)
+					col.c[k] = cDark.c[k] * (1 - t) + cLight.c[k] * t;
+				put(&pDst[i], &pSrc[i], col, x, y);
 			}
 		}
-#endif PROCESS_COLUMNS
+	}
 
+	// the image row of the seed nearest column xi in row y
+	int seedY(const int *seedRow, int xi, int y)
+	{
+		return this->window.y1 + seedRow[scratchIndex(this->window.x1 + xi, y)];
+	}
+
+	// squared-distance transform of one seed kind along the whole of row y
+	void rowTransform(int y, const int *seedRow,
+		double *f, int *nearest, double *d2, int *v, double *z)
+	{
+		int n = this->window.x2 - this->window.x1;
+		const int *s = &seedRow[scratchIndex(this->window.x1, y)];
+		int yi = y - this->window.y1;
+		for (int i = 0; i < n; i++)
+			f[i] = s[i] < 0 ? kDistInfinity : (double)(yi - s[i]) * (yi - s[i]);
+		distanceTransform1D(f, n, nearest, d2, v, z);
 	}
 };
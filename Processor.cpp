@@ -1,28 +1,196 @@
 #include "Processor.h"
+#include "Metrics.h"
+#include <chrono>
+
+// chunks per thread: many while we know nothing, a few once we can aim
+static const int kFirstFrameChunks = 8;
+static const int kProfiledChunks = 2;
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool CostProfile::plan(int pass, bool columns, int lo, int hi, int nChunks, std::vector<int> &cuts)
+{
+	std::lock_guard<std::mutex> l(lock);
+	double total = 0;
+	bool known = pass < (int)passes.size() && passes[pass].columns == columns
+		&& passes[pass].lo == lo && passes[pass].hi == hi;
+	if (known)
+		for (size_t i = 0; i < passes[pass].lineSeconds.size(); i++)
+			total += passes[pass].lineSeconds[i];
+	if (total <= 0)
+		return false;
+
+	cuts.resize(nChunks + 1);
+	cuts[0] = lo;
+	cuts[nChunks] = hi;
+
+	// walk the running cost, cutting every total/nChunks
+	const std::vector<double> &cost = passes[pass].lineSeconds;
+	double sum = 0;
+	int line = lo;
+	for (int k = 1; k < nChunks; k++) {
+		double target = total * k / nChunks;
+		while (line < hi && sum + cost[line - lo] <= target)
+			sum += cost[line++ - lo];
+		// every chunk gets at least one line, and leaves one for each after it
+		cuts[k] = Maximum(Minimum(line, hi - (nChunks - k)), cuts[k - 1] + 1);
+	}
+	return true;
+}
+
+void CostProfile::record(int pass, bool columns, int lo, int hi, const std::vector<int> &cuts, const std::vector<double> &seconds)
+{
+	std::lock_guard<std::mutex> l(lock);
+	if (pass >= (int)passes.size())
+		passes.resize(pass + 1);
+
+	PassCost &p = passes[pass];
+	bool same = p.columns == columns && p.lo == lo && p.hi == hi && (int)p.lineSeconds.size() == hi - lo;
+	p.columns = columns;
+	p.lo = lo;
+	p.hi = hi;
+	if (!same)
+		p.lineSeconds.assign(hi - lo, 0.);
+
+	// All we know is per chunk, so spread each one evenly over its lines.
+	// Average with the last frame so one preempted chunk doesn't throw
+	// the next frame's cuts off.
+	for (size_t c = 0; c + 1 < cuts.size(); c++) {
+		int lines = cuts[c + 1] - cuts[c];
+		for (int i = cuts[c]; i < cuts[c + 1]; i++) {
+			double &line = p.lineSeconds[i - lo];
+			line = same ? (line + seconds[c] / lines) * 0.5 : seconds[c] / lines;
+		}
+	}
+}
+
+Scratch *ScratchPool::take()
+{
+	std::lock_guard<std::mutex> l(lock);
+	if (idle.empty()) {
+		all.emplace_back(new Scratch);
+		return all.back().get();
+	}
+	Scratch *s = idle.back();
+	idle.pop_back();
+	return s;
+}
+
+void ScratchPool::give(Scratch *scratch)
+{
+	std::lock_guard<std::mutex> l(lock);
+	idle.push_back(scratch);
+}
 
 // callback for ThreadSuite's multithreading function
-void Processor::multiThreadProcessing(unsigned int threadId, unsigned int nThreads, void *arg)
+void Processor::multiThreadProcessing(unsigned int threadId, unsigned int /*nThreads*/, void *arg)
 {
 	Processor *proc = (Processor *)arg;
+	Scratch &s = *proc->scratch;
+	ScratchArena &arena = s.threads[threadId];
+	bool columns = proc->passSlicing(proc->pass) == kSliceColumns;
+	int nChunks = (int)s.cuts.size() - 1;
 
-	// slice the y range into the number of threads it has
-	unsigned int dy = proc->window.y2 - proc->window.y1;
-
-	unsigned int y1 = proc->window.y1 + threadId * dy / nThreads;
-	unsigned int y2 = proc->window.y1 + Minimum((threadId + 1) * dy / nThreads, dy);
+	// Take chunks until there are none left, so a thread that drew
+	// cheap ones picks up the slack for one that didn't.
+	for (int c = proc->nextChunk++; c < nChunks; c = proc->nextChunk++) {
+		OfxRectI win = proc->window;
+		if (columns) {
+			win.x1 = s.cuts[c];
+			win.x2 = s.cuts[c + 1];
+		}
+		else {
+			win.y1 = s.cuts[c];
+			win.y2 = s.cuts[c + 1];
+		}
 
-	OfxRectI win = proc->window;
-	win.y1 = y1; win.y2 = y2;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		arena.reset();
+		proc->doProcessing(win, arena);
+		s.chunkSeconds[c] = secondsSince(start);
 
-	// and render that thread on each
-	proc->doProcessing(win);
+		SliceTiming &t = s.sliceTimings[proc->firstTiming + c];
+		t.pass = proc->pass;
+		t.columns = columns;
+		t.rect = win;
+		t.seconds = s.chunkSeconds[c];
+	}
 }
 
 // function to kick off rendering across multiple CPUs
 void
-Processor::process(OfxMultiThreadSuiteV1 *pThreadSuite)
+Processor::process()
 {
-	unsigned int nThreads = 1;
-//	pThreadSuite->multiThreadNumCPUs(&nThreads);
-	pThreadSuite->multiThread(multiThreadProcessing, nThreads, (void *) this);
+	unsigned int nThreads = Maximum(host->threads, 1u);
+	Scratch &s = *scratch;
+	std::vector<int> &cuts = s.cuts;
+
+	// Any thread may draw the biggest chunk, so each gets room for what
+	// any has needed.  Like the arenas, this only ever grows.
+	if (s.threads.size() < nThreads)
+		s.threads.resize(nThreads);
+	size_t peak = 0;
+	for (size_t i = 0; i < s.threads.size(); i++)
+		peak = Maximum(peak, s.threads[i].capacity());
+	for (size_t i = 0; i < s.threads.size(); i++)
+		s.threads[i].reserve(peak);
+	s.passSeconds.assign(numPasses(), 0.);
+	s.sliceTimings.clear();
+	prepare(s.frame);
+
+	// multiThread() returns once every thread is done, so each pass
+	// sees the complete output of the one before it
+	for (pass = 0; pass < numPasses(); pass++) {
+		if (cancelled())
+			break;
+
+		bool columns = passSlicing(pass) == kSliceColumns;
+		int lo = columns ? window.x1 : window.y1;
+		int hi = columns ? window.x2 : window.y2;
+		if (hi <= lo)
+			continue;
+
+		// Without a profile, one equal chunk per thread as always.  With
+		// one, chunks of equal cost, or lots of small ones to share out
+		// on the first frame.  Column chunks are never wider than the
+		// host's strip width, which the plugin tunes to the machine's caches.
+		int minChunks = 1;
+		if (columns && host->stripWidth > 0)
+			minChunks = (hi - lo + host->stripWidth - 1) / host->stripWidth;
+		int nChunks = Minimum(Maximum((int)nThreads * (profile ? kProfiledChunks : 1), minChunks), hi - lo);
+		bool planned = profile && profile->plan(pass, columns, lo, hi, nChunks, cuts);
+		if (profile)
+			count(planned ? metrics.profileHits : metrics.profileMisses);
+		if (!planned) {
+			if (profile)
+				nChunks = Minimum(Maximum((int)nThreads * kFirstFrameChunks, minChunks), hi - lo);
+			cuts.resize(nChunks + 1);
+			for (int k = 0; k <= nChunks; k++)
+				cuts[k] = lo + (int)((long long)k * (hi - lo) / nChunks);
+		}
+
+		s.chunkSeconds.assign(nChunks, 0.);
+		nextChunk = 0;
+		firstTiming = s.sliceTimings.size();
+		SliceTiming none = { -1, columns, { 0, 0, 0, 0 }, 0. };
+		s.sliceTimings.resize(firstTiming + nChunks, none);
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		if (host->parallel)
+			host->parallel(multiThreadProcessing, nThreads, (void *) this, host->user);
+		else
+			for (unsigned int i = 0; i < nThreads; i++)
+				multiThreadProcessing(i, nThreads, (void *) this);
+		s.passSeconds[pass] = secondsSince(start);
+
+		int slot = Minimum(pass, kMetricPasses - 1);
+		count(metrics.passes[slot]);
+		count(metrics.passMicroseconds[slot], (long long)(s.passSeconds[pass] * 1e6));
+
+		if (profile && !cancelled())
+			profile->record(pass, columns, lo, hi, cuts, s.chunkSeconds);
+	}
 }
@@ -1,7 +1,10 @@
 #pragma once
 
-#include "ofxCore.h"
-#include "ofxImageEffect.h"
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include "DebandCore.h"
+#include "Scratch.h"
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -13,23 +16,90 @@ template <class T> inline T Maximum(T a, T b) { return a > b ? a : b; }
 template <class T> inline T Minimum(T a, T b) { return a < b ? a : b; }
 
 
+////////////////////////////////////////////////////////////////////////////////
+// how long one chunk of one pass took
+struct SliceTiming {
+	int pass;
+	bool columns;		// sliced by columns rather than rows
+	OfxRectI rect;
+	double seconds;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// What each row (or column) of each pass cost last frame, so the next frame
+// can be cut into chunks of equal cost rather than equal size.  Kept per
+// effect instance; renders of one instance may run at once, hence the lock.
+class CostProfile {
+public:
+	// Fill cuts with nChunks + 1 boundaries across [lo, hi).  Returns
+	// false, leaving cuts alone, if there's no matching profile yet.
+	bool plan(int pass, bool columns, int lo, int hi, int nChunks, std::vector<int> &cuts);
+
+	// remember how long each chunk between cuts took
+	void record(int pass, bool columns, int lo, int hi, const std::vector<int> &cuts, const std::vector<double> &seconds);
+
+private:
+	struct PassCost {
+		bool columns;
+		int lo, hi;
+		std::vector<double> lineSeconds;
+	};
+	std::mutex lock;
+	std::vector<PassCost> passes;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// What process() works in, kept from render to render so frames allocate
+// nothing once the first few have grown it: its books on the current
+// pass's chunks, the timings it fills in, an arena for buffers the whole
+// frame shares and one per thread.  One render at a time.
+struct Scratch {
+	ScratchArena frame;					// reset by whoever starts the render
+	std::vector<ScratchArena> threads;	// reset for each chunk a thread takes
+
+	std::vector<int> cuts;
+	std::vector<double> chunkSeconds;
+	std::vector<double> passSeconds;
+	std::vector<SliceTiming> sliceTimings;	// every chunk of every pass
+};
+
+// Scratch for renders that may run at once, such as one effect instance's:
+// each takes one no other render is using, and gives it back after.
+class ScratchPool {
+public:
+	Scratch *take();
+	void give(Scratch *scratch);
+
+private:
+	std::mutex lock;
+	std::vector<std::unique_ptr<Scratch> > all;
+	std::vector<Scratch *> idle;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 // base class to process images with
 class Processor {
 protected:
-	OfxImageEffectHandle  instance;
+	const DebandHost *host;
 	void *srcV, *dstV, *maskV;
 	OfxRectI srcRect, dstRect, maskRect;
 	int srcBytesPerLine, dstBytesPerLine, maskBytesPerLine;
 	OfxRectI  window;
+	int       pass;		// pass currently being run by process()
 
 public:
-	Processor(OfxImageEffectHandle  inst,
+	// how the window of a pass is divided up between threads
+	enum Slicing {
+		kSliceRows,		// each thread gets a band of whole rows
+		kSliceColumns	// each thread gets a band of whole columns
+	};
+
+	Processor(const DebandHost *h,
 		void *src, OfxRectI sRect, int sBytesPerLine,
 		void *dst, OfxRectI dRect, int dBytesPerLine,
 		void *mask, OfxRectI mRect, int mBytesPerLine,
 		OfxRectI  win)
-		: instance(inst)
+		: host(h)
 		, srcV(src)
 		, dstV(dst)
 		, maskV(mask)
@@ -40,10 +110,48 @@ public:
 		, dstBytesPerLine(dBytesPerLine)
 		, maskBytesPerLine(mBytesPerLine)
 		, window(win)
+		, pass(0)
+		, profile(0)
+		, scratch(&ownScratch)
+		, nextChunk(0)
+		, firstTiming(0)
 	{}
 
 	static void multiThreadProcessing(unsigned int threadId, unsigned int nThreads, void *arg);
-	void process(OfxMultiThreadSuiteV1 *pThreadSuite);
+	void process();
+
+	// If set, chunks are planned from and timed into this; otherwise
+	// each thread gets an equal share.
+	CostProfile *profile;
+
+	// What to work in.  Point it, like profile, at one kept from render to
+	// render; otherwise the processor works in its own, which dies with it.
+	Scratch *scratch;
+
+	// filled in by process(), for diagnostics; they live in scratch
+	const std::vector<double> &passSeconds() const { return scratch->passSeconds; }
+	const std::vector<SliceTiming> &sliceTimings() const { return scratch->sliceTimings; }
+
+	// Processors that need more than one sweep over the image override these.
+	// All threads finish a pass before the next one starts.
+	virtual int numPasses() { return 1; }
+	virtual Slicing passSlicing(int /*pass*/) { return kSliceRows; }
+
+	// Called once before the first pass, to take buffers the whole frame
+	// shares from frame.
+	virtual void prepare(ScratchArena & /*frame*/) {}
+
+	// scratch is the calling thread's arena, empty at the start of each call
+	virtual void doProcessing(OfxRectI window, ScratchArena &scratch) = 0;
+
+protected:
+	// whether the host has given up on this render
+	bool cancelled() const { return debandCancelled(host); }
+
+	Scratch ownScratch;
 
-	virtual void doProcessing(OfxRectI window) = 0;
+	// the current pass's chunks, between scratch->cuts; threads take the
+	// next one free until none are left
+	std::atomic<int> nextChunk;
+	size_t firstTiming;		// where this pass's chunks start in sliceTimings
 };
@@ -0,0 +1,146 @@
+#include "Quantize.h"
+#include "Metrics.h"
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+
+// finest grid looked for
+static const int kMaxLevels = 65535;
+
+// how far off a grid point a value may be, in codes, and still be on it
+static const float kTolerance = 1.f / 64;
+
+// most codes apart the closest two values can be and the grid still be found
+static const int kMaxGapCodes = 64;
+
+static bool onGrid(float v, int levels)
+{
+	float x = v * levels;
+	float code = std::floor(x + 0.5f);
+	return code >= 0 && code <= levels && std::fabs(x - code) <= kTolerance;
+}
+
+// Bins the values at the sample points, kSampleRows by kSampleColumns
+// (fewer if the window is smaller) spaced evenly over the window, with
+// each point in the middle of its share.  Returns how many bins hold
+// anything, in order, or -1 if any value is outside 0..1, NaNs included:
+// no grid fits it.
+int Quantization::sample(const void *src, OfxRectI srcRect, int srcRowBytes, OfxRectI window, int nComponents, Bin *bins)
+{
+	int w = window.x2 - window.x1, h = window.y2 - window.y1;
+	int rows = std::min(h, kSampleRows), columns = std::min(w, kSampleColumns);
+	int n = 0;
+	for (int j = 0; j < rows; j++) {
+		int y = window.y1 + (int)((2LL * j + 1) * h / (2 * rows));
+		const float *row = (const float *)((const char *)src + (ptrdiff_t)(y - srcRect.y1) * srcRowBytes);
+		for (int i = 0; i < columns; i++) {
+			int x = window.x1 + (int)((2LL * i + 1) * w / (2 * columns));
+			const float *p = row + (ptrdiff_t)(x - srcRect.x1) * nComponents;
+			for (int k = 0; k < nComponents; k++) {
+				float v = p[k];
+				if (!(v >= 0.f && v <= 1.f))
+					return -1;
+				Bin b = { v, v };
+				bins[n++] = b;
+			}
+		}
+	}
+
+	// in order, and one bin per 1/65535, lo and hi its ends
+	std::sort(bins, bins + n);
+	int used = 0;
+	for (int i = 0; i < n; i++) {
+		if (used > 0 && (int)(bins[used - 1].lo * kMaxLevels + 0.5f) == (int)(bins[i].lo * kMaxLevels + 0.5f))
+			bins[used - 1].hi = bins[i].hi;
+		else
+			bins[used++] = bins[i];
+	}
+	return used;
+}
+
+// Does every value binned sit on the grid?  A bin is narrower than any
+// grid's step, so its two ends being on the same point covers the rest.
+bool Quantization::fits(const Bin *bins, int n, int levels)
+{
+	for (int i = 0; i < n; i++) {
+		const Bin &b = bins[i];
+		if (!onGrid(b.lo, levels) || !onGrid(b.hi, levels)
+			|| std::floor(b.lo * levels + 0.5f) != std::floor(b.hi * levels + 0.5f))
+			return false;
+	}
+	return true;
+}
+
+// The step, refined from a rough guess at it: walking up the values, each
+// gap is rounded to whole steps by the step measured so far, which gets
+// sharper the further up the walk gets.  A float gap alone is far too
+// rough to tell a fine grid's levels from its neighbours'.
+double Quantization::refine(const Bin *bins, int n, double step)
+{
+	double steps = 0.;
+	double prev = 0.;
+	for (int i = 0; i < n; i++) {
+		double v = bins[i].lo;
+		double gap = std::floor((v - prev) / step + 0.5);
+		if (gap < 1.)
+			continue;
+		steps += gap;
+		prev = v;
+		step = v / steps;
+	}
+	return step;
+}
+
+// The coarsest grid the binned values fit.  The closest two of them (0
+// counts, so one value on its own still has a spacing) are some whole
+// number of steps apart: few on coarse grids, more on fine ones, as a
+// frame seldom uses every code of those.
+int Quantization::derive(const Bin *bins, int n)
+{
+	double gap = 1.;
+	double prev = 0.;
+	for (int i = 0; i < n; i++) {
+		double v = bins[i].lo;
+		if (v > prev && v - prev < gap)
+			gap = v - prev;
+		prev = v;
+	}
+
+	for (int codes = 1; codes <= kMaxGapCodes; codes++) {
+		double l = std::floor(1. / refine(bins, n, gap / codes) + 0.5);
+		if (l > kMaxLevels)
+			break;
+		if (l >= 1. && fits(bins, n, (int)l))
+			return (int)l;
+	}
+	return 0;
+}
+
+int Quantization::find(const void *src, OfxRectI srcRect, int srcRowBytes, OfxRectI window, int nComponents)
+{
+	Bin bins[kMaxBins];
+	int n = sample(src, srcRect, srcRowBytes, window, nComponents, bins);
+	if (n < 0) {
+		count(metrics.gridMisses);
+		levels = 0;
+		return 0;
+	}
+
+	// nothing but 0s and 1s says nothing about the grid
+	bool between = false;
+	for (int i = 0; i < n && !between; i++)
+		between = bins[i].hi > 0.f && bins[i].lo < 1.f;
+	if (!between)
+		return 0;
+
+	int kept = levels;
+	if (kept > 0 && fits(bins, n, kept)) {
+		count(metrics.gridHits);
+		return kept;
+	}
+	count(metrics.gridMisses);
+
+	int found = derive(bins, n);
+	levels = found;
+	return found;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include "ofxCore.h"
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Most float sources are up-converted 8 or 10 bit video, so every value is
+// some code / levels.  Knowing levels gives the kernels a step to limit
+// band ends to, and makes a pixel's bits a key for its codes, so bands can
+// be found with integer compares (ProcessRGBA's KEYED kernels).
+
+// The grid one instance's float source sits on.  Renders of one instance
+// may run at once, so find() takes no lock: each works on its own sample,
+// and only the levels found are kept, atomically.
+class Quantization {
+public:
+	Quantization() : levels(0) {}
+
+	// Levels of this frame's float source, worked out from a lattice of
+	// kSampleRows by kSampleColumns pixels spread evenly over the window:
+	// the grid kept from earlier frames if the sample still fits it,
+	// otherwise the coarsest one the spacing of the sampled values says
+	// they sit on.  0 if there's none up to 65535 levels, a sampled value
+	// is outside 0..1 or not a number, or there's nothing but 0s and 1s,
+	// which fit every grid.  src is float pixels of nComponents channels.
+	// Costs the same whatever the window's size.
+	int find(const void *src, OfxRectI srcRect, int srcRowBytes, OfxRectI window, int nComponents);
+
+	static const int kSampleRows = 32;
+	static const int kSampleColumns = 32;
+
+private:
+	// the sampled values that fell in one 1/65535 wide bin
+	struct Bin {
+		float lo, hi;
+		bool operator<(const Bin &o) const { return lo < o.lo; }
+	};
+	static const int kMaxBins = kSampleRows * kSampleColumns * 4;
+
+	static int sample(const void *src, OfxRectI srcRect, int srcRowBytes, OfxRectI window, int nComponents, Bin *bins);
+	static bool fits(const Bin *bins, int n, int levels);
+	static double refine(const Bin *bins, int n, double step);
+	static int derive(const Bin *bins, int n);
+
+	std::atomic<int> levels;
+};
@@ -0,0 +1,767 @@
+#include "Reference.h"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstddef>
+
+// Nothing here comes from the kernels' headers: pixels are read and
+// written through Sample below, so a slip in ProcessRGBA.h's pixel
+// helpers shows up as a difference instead of being copied.
+
+// Rec. 709 luma weights
+static const float kReferenceLumaR = 0.2126f;
+static const float kReferenceLumaG = 0.7152f;
+static const float kReferenceLumaB = 0.0722f;
+
+// A float source's grid is looked for at this many points down and across
+// the window, the lattice the kernels' Quantization samples, so the two
+// see the same values.
+static const int kGridSampleRows = 32;
+static const int kGridSampleColumns = 32;
+
+// finest grid looked for, and how far off a grid point a value may be, in
+// codes, and still be on it
+static const int kMaxGridLevels = 65535;
+static const double kGridTolerance = 1. / 64;
+
+// IEEE half to float, every value exactly
+static float halfBitsToFloat(unsigned short h)
+{
+	unsigned int sign = (unsigned int)(h & 0x8000) << 16;
+	unsigned int exp = (h >> 10) & 31, man = h & 1023;
+	if (exp == 0)
+	{
+		// zero or denormal: man * 2^-24
+		float v = std::ldexp((float)man, -24);
+		return sign ? -v : v;
+	}
+	unsigned int bits = exp == 31
+		? sign | 0x7f800000 | man << 13
+		: sign | (exp - 15 + 127) << 23 | man << 13;
+	float f;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+// float to IEEE half, rounding to nearest even
+static unsigned short floatToHalfBits(float f)
+{
+	unsigned int x;
+	memcpy(&x, &f, sizeof(x));
+	unsigned short sign = (unsigned short)((x >> 16) & 0x8000);
+	unsigned int a = x & 0x7fffffff;
+
+	if (a >= 0x7f800000)
+		return sign | 0x7c00 | (a > 0x7f800000 ? 0x200 | (a >> 13 & 0x3ff) : 0);	// infinity, quiet NaN
+	if (a >= 0x477ff000)
+		return sign | 0x7c00;		// 65520 and up round to infinity
+	if (a < 0x38800000)
+	{
+		// under the smallest normal: a multiple of 2^-24, which may round up to it
+		float v;
+		memcpy(&v, &a, sizeof(v));
+		return sign | (unsigned short)std::nearbyint(v * 16777216.f);
+	}
+
+	unsigned int h = ((a >> 23) - 127 + 15) << 10 | (a >> 13 & 0x3ff);
+	unsigned int rest = a & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (h & 1)))
+		h++;		// a carry out of the mantissa steps the exponent, as it should
+	return sign | (unsigned short)h;
+}
+
+// One sample of each depth: how it's stored, its range, and its value.
+// Half samples compare by their bits, as the kernels' do, bar -0 and +0,
+// which are equal as they are for float.
+template <int DEPTH> struct Sample;
+template <> struct Sample<8> {
+	typedef unsigned char T;
+	static const int max = 255;
+	static const bool isFloat = false;
+	static float get(T t) { return t; }
+	static void set(T &t, float v) { t = (T)v; }
+	static bool same(T a, T b) { return a == b; }
+};
+template <> struct Sample<16> {
+	typedef unsigned short T;
+	static const int max = 65535;
+	static const bool isFloat = false;
+	static float get(T t) { return t; }
+	static void set(T &t, float v) { t = (T)v; }
+	static bool same(T a, T b) { return a == b; }
+};
+template <> struct Sample<kBitDepthHalf> {
+	typedef unsigned short T;
+	static const int max = 1;
+	static const bool isFloat = true;
+	static float get(T t) { return halfBitsToFloat(t); }
+	static void set(T &t, float v) { t = floatToHalfBits(v); }
+	static bool same(T a, T b) { return a == b || ((a | b) & 0x7fff) == 0; }
+};
+template <> struct Sample<32> {
+	typedef float T;
+	static const int max = 1;
+	static const bool isFloat = true;
+	static float get(T t) { return t; }
+	static void set(T &t, float v) { t = v; }
+	static bool same(T a, T b) { return a == b; }
+};
+
+// a pixel as floats, in the output's range
+template <int N> struct ReferenceColour {
+	float c[N];
+};
+
+// A render of one window, N channels of SRC samples in and of DST out.
+// Everything a kernel variant fixes at compile time is a plain member here.
+template <int SRC, int DST, int N>
+class Reference {
+public:
+	typedef typename Sample<SRC>::T T;
+	typedef typename Sample<DST>::T DT;
+	typedef ReferenceColour<N> Colour;
+
+	// halfStep is in the output's units; levels is a float source's grid,
+	// or 0
+	Reference(const KernelArgs &a, int direction, bool dither, float halfStep, int levels = 0)
+		: a(a)
+		, direction(direction)
+		, dither(dither)
+		, w(a.window.x2 - a.window.x1)
+		, h(a.window.y2 - a.window.y1)
+		, halfStep(halfStep)
+		, codes(levels > 0 ? (double)levels : Sample<SRC>::isFloat ? 65535. : 1.)
+	{}
+
+	// The grid a float source sits on: the fewest levels every sampled
+	// value is within kGridTolerance codes of, trying each count in turn.
+	// 0 for other sources, if no count up to kMaxGridLevels fits, if a
+	// value is outside 0..1 or not a number, or if there's nothing but 0s
+	// and 1s, which fit every grid.
+	static int sourceLevels(const KernelArgs &a)
+	{
+		if (SRC != 32)
+			return 0;
+
+		int w = a.window.x2 - a.window.x1, h = a.window.y2 - a.window.y1;
+		int rows = std::min(h, kGridSampleRows), columns = std::min(w, kGridSampleColumns);
+		std::vector<double> values;
+		bool between = false;
+		for (int j = 0; j < rows; j++)
+			for (int i = 0; i < columns; i++)
+			{
+				int x = a.window.x1 + (int)((2LL * i + 1) * w / (2 * columns));
+				int y = a.window.y1 + (int)((2LL * j + 1) * h / (2 * rows));
+				const float *p = (const float *)((const char *)a.src + (ptrdiff_t)(y - a.srcRect.y1) * a.srcRowBytes) + (ptrdiff_t)(x - a.srcRect.x1) * N;
+				for (int k = 0; k < N; k++)
+				{
+					double v = p[k];
+					if (!(v >= 0 && v <= 1))
+						return 0;
+					between |= v > 0 && v < 1;
+					values.push_back(v);
+				}
+			}
+		if (!between)
+			return 0;
+
+		std::sort(values.begin(), values.end());
+		values.erase(std::unique(values.begin(), values.end()), values.end());
+		for (int levels = 1; levels <= kMaxGridLevels; levels++)
+		{
+			size_t i = 0;
+			while (i < values.size() && std::fabs(values[i] * levels - std::floor(values[i] * levels + 0.5)) <= kGridTolerance)
+				i++;
+			if (i == values.size())
+				return levels;
+		}
+		return 0;
+	}
+
+	// As runKernel, runFloatKernel and runLuma work it out: half a code
+	// for integers, half the grid step for float, nothing for half.
+	static float sourceHalfStep(const KernelArgs &a, int levels)
+	{
+		if (a.halfStep && !Sample<SRC>::isFloat)
+			return 0.5f * scale();
+		if (a.halfStep && levels > 0)
+			return 0.5f / levels;
+		return 0;
+	}
+
+	void run()
+	{
+		if (w <= 0 || h <= 0)
+			return;
+
+		if (a.mode == kModeDistance)
+		{
+			distance();
+			return;
+		}
+
+		if (direction != kDirColumns)
+		{
+			if (direction == kDirBoth)
+				rows.resize((size_t)w * h * N);
+			for (int y = 0; y < h; y++)
+				rowPass(y);
+		}
+		if (direction != kDirRows)
+			for (int x = 0; x < w; x++)
+				columnPass(x);
+	}
+
+	// Luma only: Y of every pixel, in the output's range
+	void split(std::vector<float> &luma)
+	{
+		luma.resize((size_t)w * h);
+		for (int y = 0; y < h; y++)
+			for (int x = 0; x < w; x++)
+			{
+				Colour c = load(src(x, y));
+				luma[(size_t)y * w + x] = c.c[0] * kReferenceLumaR + c.c[1] * kReferenceLumaG + c.c[2] * kReferenceLumaB;
+			}
+	}
+
+	// and the change in Y added back to R, G and B
+	void merge(const std::vector<float> &luma, const std::vector<float> &lumaOut)
+	{
+		for (int y = 0; y < h; y++)
+			for (int x = 0; x < w; x++)
+			{
+				float d = lumaOut[(size_t)y * w + x] - luma[(size_t)y * w + x];
+				if (d == 0)
+				{
+					copy(dst(x, y), src(x, y));
+					continue;
+				}
+				Colour c = load(src(x, y));
+				for (int k = 0; k < 3; k++)
+					c.c[k] += d;
+				put(x, y, c);
+			}
+	}
+
+private:
+	const KernelArgs &a;
+	int direction;
+	bool dither;
+	int w, h;
+	float halfStep;
+	double codes;				// per unit of source sample, for bandClass
+	std::vector<DT> rows;		// the row pass's result, with both directions
+
+	// what a source value is multiplied by to put it in the output's range
+	static float scale()
+	{
+		return SRC == DST ? 1.f : (float)Sample<DST>::max / Sample<SRC>::max;
+	}
+
+	// window-relative pixels, as their first sample
+	T *src(int x, int y)
+	{
+		return (T *)((char *)a.src + (ptrdiff_t)(a.window.y1 + y - a.srcRect.y1) * a.srcRowBytes) + (a.window.x1 + x - a.srcRect.x1) * N;
+	}
+	DT *dst(int x, int y)
+	{
+		return (DT *)((char *)a.dst + (ptrdiff_t)(a.window.y1 + y - a.dstRect.y1) * a.dstRowBytes) + (a.window.x1 + x - a.dstRect.x1) * N;
+	}
+
+	// 0..1, at the source's depth; no mask, or no mask pixel, means full effect
+	float maskAt(int x, int y)
+	{
+		x += a.window.x1;
+		y += a.window.y1;
+		if (!a.mask || x < a.maskRect.x1 || x >= a.maskRect.x2 || y < a.maskRect.y1 || y >= a.maskRect.y2)
+			return 1.f;
+		T m = ((T *)((char *)a.mask + (ptrdiff_t)(y - a.maskRect.y1) * a.maskRowBytes))[x - a.maskRect.x1];
+		return Sample<SRC>::isFloat ? Sample<SRC>::get(m) : Sample<SRC>::get(m) / Sample<SRC>::max;
+	}
+
+	static bool sameColour(const T *p, const T *q)
+	{
+		for (int k = 0; k < N; k++)
+			if (!Sample<SRC>::same(p[k], q[k]))
+				return false;
+		return true;
+	}
+
+	static Colour load(const T *p)
+	{
+		Colour c;
+		for (int k = 0; k < N; k++)
+		{
+			c.c[k] = Sample<SRC>::get(p[k]);
+			if (SRC != DST)
+				c.c[k] *= scale();
+		}
+		return c;
+	}
+
+	// integers round with bias 0.5, or dither with a threshold
+	static void store(DT *p, const Colour &c, float bias)
+	{
+		for (int k = 0; k < N; k++)
+		{
+			float v = c.c[k];
+			if (!Sample<DST>::isFloat)
+			{
+				v = std::floor(v + bias);
+				v = v < 0 ? 0 : v > Sample<DST>::max ? (float)Sample<DST>::max : v;
+			}
+			Sample<DST>::set(p[k], v);
+		}
+	}
+
+	// a pixel outside every band
+	static void copy(DT *d, const T *s)
+	{
+		if (SRC == DST)
+			memcpy(d, s, N * sizeof(T));
+		else
+			store(d, load(s), 0.5f);
+	}
+
+	// halfway to the pixel outside the band, or at most halfStep
+	Colour bandEnd(const Colour &out, const Colour &in)
+	{
+		Colour c;
+		for (int k = 0; k < N; k++)
+		{
+			c.c[k] = (out.c[k] + in.c[k]) * 0.5f;
+			if (halfStep > 0)
+			{
+				if (c.c[k] > in.c[k] + halfStep) c.c[k] = in.c[k] + halfStep;
+				if (c.c[k] < in.c[k] - halfStep) c.c[k] = in.c[k] - halfStep;
+			}
+		}
+		return c;
+	}
+
+	static Colour ramp(const Colour &left, const Colour &right, int numer, int denom)
+	{
+		Colour c;
+		for (int k = 0; k < N; k++)
+			c.c[k] = left.c[k] * (denom - numer) / denom + right.c[k] * numer / denom;
+		return c;
+	}
+
+	// mix with the source by the mask, then dither and store
+	void put(int x, int y, Colour c)
+	{
+		if (a.mask)
+		{
+			float m = maskAt(x, y);
+			Colour s = load(src(x, y));
+			for (int k = 0; k < N; k++)
+				c.c[k] = s.c[k] + (c.c[k] - s.c[k]) * m;
+		}
+
+		static const unsigned char bayer[4][4] = {
+			{  0,  8,  2, 10 },
+			{ 12,  4, 14,  6 },
+			{  3, 11,  1,  9 },
+			{ 15,  7, 13,  5 }
+		};
+		int xa = a.window.x1 + x, ya = a.window.y1 + y;
+		store(dst(x, y), c, dither ? (bayer[ya & 3][xa & 3] + 0.5f) / 16.f : 0.5f);
+	}
+
+	// Every run of equal pixels along the row is a band, ramped from
+	// halfway to the pixel left of it to halfway to the one right of it.
+	// A band of one pixel is copied, unless it's the last in the row.
+	void rowPass(int y)
+	{
+		for (int xLeft = 0; xLeft < w; )
+		{
+			int xRight = xLeft;
+			while (xRight + 1 < w && sameColour(src(xLeft, y), src(xRight + 1, y)))
+				xRight++;
+
+			if (xLeft == xRight && xRight < w - 1)
+			{
+				if (direction == kDirBoth)
+					copy(&rows[((size_t)y * w + xLeft) * N], src(xLeft, y));
+				else
+					copy(dst(xLeft, y), src(xLeft, y));
+			}
+			else
+			{
+				Colour left = load(src(xLeft, y));
+				if (xLeft > 0)
+					left = bandEnd(load(src(xLeft - 1, y)), left);
+				Colour right = load(src(xRight, y));
+				if (xRight + 1 < w)
+					right = bandEnd(load(src(xRight + 1, y)), right);
+
+				int denom = (xRight - xLeft + 1) + 1;
+				for (int x = xLeft; x <= xRight; x++)
+				{
+					Colour c = ramp(left, right, (x - xLeft) + 1, denom);
+					if (direction == kDirBoth)
+						store(&rows[((size_t)y * w + x) * N], c, 0.5f);
+					else
+						put(x, y, c);
+				}
+			}
+			xLeft = xRight + 1;
+		}
+	}
+
+	// The same down a column.  With both directions each ramped pixel is
+	// the mean of its column ramp and its row pass result; pixels copied
+	// here are copied whatever the row pass made of them.
+	void columnPass(int x)
+	{
+		for (int yTop = 0; yTop < h; )
+		{
+			int yBot = yTop;
+			while (yBot + 1 < h && sameColour(src(x, yTop), src(x, yBot + 1)))
+				yBot++;
+
+			if (yTop == yBot && yBot < h - 1)
+				copy(dst(x, yTop), src(x, yTop));
+			else
+			{
+				Colour top = load(src(x, yTop));
+				if (yTop > 0)
+					top = bandEnd(load(src(x, yTop - 1)), top);
+				Colour bot = load(src(x, yBot));
+				if (yBot + 1 < h)
+					bot = bandEnd(load(src(x, yBot + 1)), bot);
+
+				int denom = (yBot - yTop + 1) + 1;
+				for (int y = yTop; y <= yBot; y++)
+				{
+					Colour c = ramp(top, bot, (y - yTop) + 1, denom);
+					if (direction == kDirBoth)
+					{
+						const DT *r = &rows[((size_t)y * w + x) * N];
+						Colour d;
+						for (int k = 0; k < N; k++)
+						{
+							d.c[k] = Sample<DST>::get(r[k]);
+							d.c[k] += c.c[k];
+							d.c[k] /= 2.f;
+						}
+						c = d;
+					}
+					put(x, y, c);
+				}
+			}
+			yTop = yBot + 1;
+		}
+	}
+
+	// Distance: a band pixel lies between the nearest pixel of its own
+	// colour that borders a darker one and the nearest that borders a
+	// lighter one, by Euclidean distance.  Bands are split into more
+	// classes than there are channels by brightness in codes (the grid's
+	// for float on one, else 16-bit codes for float and half), and only
+	// contours of the pixel's class count, so a neighbouring band a step
+	// away in any channels doesn't; one of another colour that's still
+	// nearest means no contour on that side.
+	enum {
+		kDark = 1,
+		kLight = 2,
+		kFlat = 4,
+		kClasses = N < 2 ? 2 : N < 4 ? 4 : 8
+	};
+
+	double brightness(int x, int y)
+	{
+		const T *p = src(x, y);
+		double b = 0;
+		for (int k = 0; k < N; k++)
+			b += Sample<SRC>::get(p[k]);
+		return b;
+	}
+
+	int bandClass(int x, int y)
+	{
+		double m = std::fmod(std::floor(brightness(x, y) * codes + 0.5), (double)kClasses);
+		if (m < 0)
+			m += kClasses;
+		return m >= 0 && m < kClasses ? (int)m : 0;
+	}
+
+	bool inside(int x, int y)
+	{
+		return x >= 0 && x < w && y >= 0 && y < h;
+	}
+
+	// halfway from the contour pixel to its neighbour across the contour
+	// closest to it in brightness
+	Colour contourColour(int x, int y, bool darkSide)
+	{
+		static const int dx[4] = { -1, 1, 0, 0 };
+		static const int dy[4] = { 0, 0, -1, 1 };
+
+		double bIn = brightness(x, y);
+		int out = -1;
+		double bOut = 0;
+		for (int i = 0; i < 4; i++)
+		{
+			if (!inside(x + dx[i], y + dy[i]))
+				continue;
+			double b = brightness(x + dx[i], y + dy[i]);
+			if (darkSide ? (b < bIn && (out < 0 || b > bOut)) : (b > bIn && (out < 0 || b < bOut)))
+			{
+				out = i;
+				bOut = b;
+			}
+		}
+
+		Colour c = load(src(x, y));
+		if (out >= 0)
+			c = bandEnd(load(src(x + dx[out], y + dy[out])), c);
+		return c;
+	}
+
+	// Of the seeds in columns, the one nearest (x, y): the least squared
+	// distance, then the leftmost, then the upper.  Columns go outwards
+	// from x until none further can be nearer; in each, the seed rows are
+	// in order, so the nearest is a search away.
+	bool nearestSeed(const std::vector<std::vector<int> > &columns, int x, int y, int &sx, int &sy, double &d2)
+	{
+		bool found = false;
+		for (int dx = 0; dx < w && (!found || (double)dx * dx <= d2); dx++)
+			for (int side = -1; side <= 1; side += 2)
+			{
+				int cx = x + side * dx;
+				if ((dx == 0 && side > 0) || cx < 0 || cx >= w)
+					continue;
+				const std::vector<int> &seeds = columns[cx];
+				if (seeds.empty())
+					continue;
+
+				// the first seed at or below y, and the one above it
+				size_t i = 0;
+				while (i < seeds.size() && seeds[i] < y)
+					i++;
+				int cy = -1;
+				if (i > 0)
+					cy = seeds[i - 1];
+				if (i < seeds.size() && (cy < 0 || seeds[i] - y < y - cy))
+					cy = seeds[i];
+
+				double d = (double)dx * dx + (double)(y - cy) * (y - cy);
+				if (!found || d < d2 || (d == d2 && (cx < sx || (cx == sx && cy < sy))))
+				{
+					found = true;
+					sx = cx;
+					sy = cy;
+					d2 = d;
+				}
+			}
+		return found;
+	}
+
+	void distance()
+	{
+		static const int dx[4] = { -1, 1, 0, 0 };
+		static const int dy[4] = { 0, 0, -1, 1 };
+
+		// classify every pixel, and list each class's contours by column
+		std::vector<unsigned char> flags((size_t)w * h);
+		std::vector<int> classes((size_t)w * h);
+		std::vector<std::vector<int> > dark[kClasses], light[kClasses];
+		for (int c = 0; c < kClasses; c++)
+		{
+			dark[c].resize(w);
+			light[c].resize(w);
+		}
+		for (int x = 0; x < w; x++)
+			for (int y = 0; y < h; y++)
+			{
+				double b = brightness(x, y);
+				unsigned char f = 0;
+				for (int i = 0; i < 4; i++)
+				{
+					int nx = x + dx[i], ny = y + dy[i];
+					if (!inside(nx, ny))
+						continue;
+					if (sameColour(src(x, y), src(nx, ny)))
+						f |= kFlat;
+					else if (brightness(nx, ny) < b)
+						f |= kDark;
+					else if (brightness(nx, ny) > b)
+						f |= kLight;
+				}
+				int c = bandClass(x, y);
+				flags[(size_t)y * w + x] = f;
+				classes[(size_t)y * w + x] = c;
+				if (f & kDark)
+					dark[c][x].push_back(y);
+				if (f & kLight)
+					light[c][x].push_back(y);
+			}
+
+		for (int y = 0; y < h; y++)
+			for (int x = 0; x < w; x++)
+			{
+				if (!(flags[(size_t)y * w + x] & kFlat))
+				{
+					copy(dst(x, y), src(x, y));
+					continue;
+				}
+
+				int c = classes[(size_t)y * w + x];
+				int xd = 0, yd = 0, xl = 0, yl = 0;
+				double d2Dark = 0, d2Light = 0;
+				bool hasDark = nearestSeed(dark[c], x, y, xd, yd, d2Dark) && sameColour(src(xd, yd), src(x, y));
+				bool hasLight = nearestSeed(light[c], x, y, xl, yl, d2Light) && sameColour(src(xl, yl), src(x, y));
+				if (!hasDark && !hasLight)
+				{
+					copy(dst(x, y), src(x, y));
+					continue;
+				}
+
+				// distances run to the pixel across the contour; a missing
+				// side takes the other's colour
+				Colour cDark, cLight;
+				float t;
+				if (hasDark && hasLight)
+				{
+					cDark = contourColour(xd, yd, true);
+					cLight = contourColour(xl, yl, false);
+					double dDark = std::sqrt(d2Dark) + 1;
+					double dLight = std::sqrt(d2Light) + 1;
+					t = (float)(dDark / (dDark + dLight));
+				}
+				else if (hasDark)
+				{
+					cDark = cLight = contourColour(xd, yd, true);
+					t = 0;
+				}
+				else
+				{
+					cDark = cLight = contourColour(xl, yl, false);
+					t = 0;
+				}
+
+				Colour out;
+				for (int k = 0; k < N; k++)
+					out.c[k] = cDark.c[k] * (1 - t) + cLight.c[k] * t;
+				put(x, y, out);
+			}
+	}
+};
+
+template <int SRC, int DST, int N, int DIR, bool DITHER>
+static void runReference(const KernelArgs &a)
+{
+	int levels = Reference<SRC, DST, N>::sourceLevels(a);
+	Reference<SRC, DST, N> ref(a, DIR, DITHER, Reference<SRC, DST, N>::sourceHalfStep(a, levels), levels);
+	ref.run();
+}
+
+// Luma only: Y split out into a plane, debanded as a one-channel float
+// image with no mask or dither, and the change added back.
+template <int SRC, int DST, int N, int DIR, bool DITHER>
+static void runLumaReference(const KernelArgs &a)
+{
+	int w = a.window.x2 - a.window.x1, h = a.window.y2 - a.window.y1;
+	if (w <= 0 || h <= 0)
+		return;
+
+	Reference<SRC, DST, N> ref(a, DIR, DITHER, 0);
+	std::vector<float> luma, lumaOut((size_t)w * h);
+	ref.split(luma);
+
+	KernelArgs y = a;
+	y.src = &luma[0];
+	y.srcRect = a.window;
+	y.srcRowBytes = w * (int)sizeof(float);
+	y.dst = &lumaOut[0];
+	y.dstRect = a.window;
+	y.dstRowBytes = w * (int)sizeof(float);
+	y.mask = 0;
+	Reference<32, 32, 1> yRef(y, DIR, false,
+		Reference<SRC, DST, N>::sourceHalfStep(a, Reference<SRC, DST, N>::sourceLevels(a)));
+	yRef.run();
+
+	ref.merge(luma, lumaOut);
+}
+
+// [luma][dither][direction] for one source and output depth and channel count
+#define REFERENCE_VARIANTS(SRC, DST, N) \
+	{ \
+		{ \
+			{ runReference<SRC, DST, N, kDirBoth, false>, runReference<SRC, DST, N, kDirRows, false>, runReference<SRC, DST, N, kDirColumns, false> }, \
+			{ runReference<SRC, DST, N, kDirBoth, true>, runReference<SRC, DST, N, kDirRows, true>, runReference<SRC, DST, N, kDirColumns, true> } \
+		}, \
+		{ \
+			{ runLumaReference<SRC, DST, N, kDirBoth, false>, runLumaReference<SRC, DST, N, kDirRows, false>, runLumaReference<SRC, DST, N, kDirColumns, false> }, \
+			{ runLumaReference<SRC, DST, N, kDirBoth, true>, runLumaReference<SRC, DST, N, kDirRows, true>, runLumaReference<SRC, DST, N, kDirColumns, true> } \
+		} \
+	}
+
+// [RGBA, RGB] for one source and output depth; alpha images have no luma
+#define REFERENCE_LAYOUTS(SRC, DST) \
+	{ REFERENCE_VARIANTS(SRC, DST, 4), REFERENCE_VARIANTS(SRC, DST, 3) }
+
+// [8, 16, half, float, 8 to 16, 8 to float, 16 to float][RGBA, RGB][luma][dither][direction]
+static const KernelFn references[7][2][2][2][3] = {
+	REFERENCE_LAYOUTS(8, 8),
+	REFERENCE_LAYOUTS(16, 16),
+	REFERENCE_LAYOUTS(kBitDepthHalf, kBitDepthHalf),
+	REFERENCE_LAYOUTS(32, 32),
+	REFERENCE_LAYOUTS(8, 16),
+	REFERENCE_LAYOUTS(8, 32),
+	REFERENCE_LAYOUTS(16, 32)
+};
+
+// [8, 16, half, float, 8 to 16, 8 to float, 16 to float][dither][direction]
+#define ALPHA_VARIANTS(SRC, DST) \
+	{ \
+		{ runReference<SRC, DST, 1, kDirBoth, false>, runReference<SRC, DST, 1, kDirRows, false>, runReference<SRC, DST, 1, kDirColumns, false> }, \
+		{ runReference<SRC, DST, 1, kDirBoth, true>, runReference<SRC, DST, 1, kDirRows, true>, runReference<SRC, DST, 1, kDirColumns, true> } \
+	}
+static const KernelFn alphaReferences[7][2][3] = {
+	ALPHA_VARIANTS(8, 8),
+	ALPHA_VARIANTS(16, 16),
+	ALPHA_VARIANTS(kBitDepthHalf, kBitDepthHalf),
+	ALPHA_VARIANTS(32, 32),
+	ALPHA_VARIANTS(8, 16),
+	ALPHA_VARIANTS(8, 32),
+	ALPHA_VARIANTS(16, 32)
+};
+
+// table row for a source and output depth, or -1
+static int formatIndex(int srcBitDepth, int dstBitDepth)
+{
+	if (srcBitDepth == dstBitDepth)
+	{
+		switch (srcBitDepth) {
+		case 8: return 0;
+		case 16: return 1;
+		case kBitDepthHalf: return 2;
+		case 32: return 3;
+		default: return -1;
+		}
+	}
+	if (srcBitDepth == 8 && dstBitDepth == 16) return 4;
+	if (srcBitDepth == 8 && dstBitDepth == 32) return 5;
+	if (srcBitDepth == 16 && dstBitDepth == 32) return 6;
+	return -1;
+}
+
+KernelFn findReferenceKernel(int srcBitDepth, int dstBitDepth, int components, int direction, bool dither, bool luma)
+{
+	int format = formatIndex(srcBitDepth, dstBitDepth);
+	if (format < 0 || (components != 4 && components != 3 && components != 1))
+		return 0;
+	if (direction < kDirBoth || direction > kDirColumns)
+		direction = kDirBoth;
+
+	// Dithering only means anything when rounding to integers.
+	bool floatOut = dstBitDepth == 32 || dstBitDepth == kBitDepthHalf;
+	int d = dither && !floatOut ? 1 : 0;
+	if (components == 1)
+		return alphaReferences[format][d][direction];
+	return references[format][components == 3 ? 1 : 0][luma ? 1 : 0][d][direction];
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "KernelTable.h"
+
+
+////////////////////////////////////////////////////////////////////////////////
+// The kernels written as plainly as they can be: one thread, the row pass
+// into a buffer the size of the window, then each column from top to
+// bottom; distances found by searching for the nearest contour; luma split
+// into a whole plane and merged back.  No fused passes, slices, strips,
+// reused rows or columns, or keyed compares, and its own pixel access.  It
+// is slow, and it is the definition: every kernel that findKernel returns
+// must match it bit for bit, whatever the thread count, strip width or
+// KernelVariant.
+// debandpipe --verify checks that.
+
+// Takes the same formats as findKernel, and is used the same way, in
+// ramps or distance mode.  A mask is applied if args.mask is set.  host,
+// stats, profile, quant and scratch are ignored: it finds a float
+// source's grid itself, on every frame.
+KernelFn findReferenceKernel(int srcBitDepth, int dstBitDepth, int components, int direction, bool dither, bool luma);
@@ -0,0 +1,55 @@
+#include "Scratch.h"
+
+void *ScratchArena::takeBytes(size_t bytes)
+{
+	bytes = (bytes + kAlign - 1) & ~(kAlign - 1);
+	if (blocks.empty() || blocks.back().size - used < bytes)
+	{
+		// at least double, so a render that keeps taking grows in few steps
+		size_t size = blocks.empty() ? kFirstBlock : 2 * blocks.back().size;
+		grow(size < bytes ? bytes : size);
+	}
+
+	char *p = blocks.back().base + used;
+	used += bytes;
+	return p;
+}
+
+void ScratchArena::reset()
+{
+	// one block the size of them all, so next time everything fits in it
+	if (blocks.size() > 1)
+	{
+		size_t total = capacity();
+		blocks.clear();
+		grow(total);
+	}
+	used = 0;
+}
+
+size_t ScratchArena::capacity() const
+{
+	size_t total = 0;
+	for (size_t i = 0; i < blocks.size(); i++)
+		total += blocks[i].size;
+	return total;
+}
+
+void ScratchArena::reserve(size_t bytes)
+{
+	size_t total = capacity();
+	if (total >= bytes && blocks.size() <= 1)
+		return;
+	blocks.clear();
+	grow(total > bytes ? total : bytes);
+}
+
+void ScratchArena::grow(size_t size)
+{
+	Block b;
+	b.memory.reset(new char[size + kAlign - 1]);
+	b.base = (char *)(((size_t)b.memory.get() + kAlign - 1) & ~(kAlign - 1));
+	b.size = size;
+	blocks.push_back(std::move(b));
+	used = 0;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Working memory that outlives a render, so the next one needn't allocate.
+// take() hands out blocks that last until reset(); reset() keeps the memory
+// for next time, merged into one block as big as the most ever taken at
+// once.  After a frame or two of the same size, taking costs a pointer bump
+// and allocates nothing.
+//
+// Blocks are uninitialised and aligned to a cache line, so two threads'
+// blocks never share one.  Only plain types belong in them: nothing is
+// constructed or destroyed.
+class ScratchArena {
+public:
+	ScratchArena() : used(0) {}
+
+	template <class T>
+	T *take(size_t n)
+	{
+		return (T *)takeBytes(n * sizeof(T));
+	}
+
+	// give back everything taken
+	void reset();
+
+	// Bytes take() can hand out after a reset() without allocating, and
+	// making sure of at least that many, in one block.  Neither may be
+	// called while anything taken is in use.
+	size_t capacity() const;
+	void reserve(size_t bytes);
+
+private:
+	static const size_t kAlign = 64;
+	static const size_t kFirstBlock = 64 * 1024;
+
+	struct Block {
+		std::unique_ptr<char[]> memory;
+		char *base;			// memory, aligned
+		size_t size;		// usable from base
+	};
+	std::vector<Block> blocks;	// all but the last are full
+	size_t used;				// bytes taken from the last
+
+	void *takeBytes(size_t bytes);
+	void grow(size_t size);
+};
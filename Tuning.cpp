@@ -0,0 +1,279 @@
+#include "Tuning.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <mutex>
+#include "ofxPixels.h"
+#include "KernelTable.h"
+#include "Half.h"
+
+#ifdef _WIN32
+#  include <direct.h>
+#else
+#  include <unistd.h>
+#  include <sys/stat.h>
+#endif
+
+// the synthetic frame that gets timed
+static const int kFrameWidth = 1920;
+static const int kFrameHeight = 1080;
+
+// renders of each setting; the fastest counts
+static const int kRuns = 3;
+
+// column strip widths tried; 0 is one strip per chunk, however wide
+static const int kStripWidths[] = { 0, 1024, 512, 256, 128 };
+
+// a setting has to beat the best so far by this much to replace it, so
+// timing noise doesn't pick something odd over the defaults
+static const double kMargin = 0.97;
+
+// Cache files say which of these they are; older ones were tuned without
+// some of today's settings, so get tuned again.
+static const int kCacheVersion = 2;
+
+// whether loadTuning left the timing to tuneOnce
+static bool untuned;
+static std::once_flag tuned;
+
+// Read "key=value" pairs, separated by commas or lines, into t.  cpus is
+// the CPU count a cache file was tuned for, and version its kCacheVersion.
+// # starts a comment.
+static void parseTuning(const char *text, Tuning &t, int &cpus, int &version)
+{
+	while (*text) {
+		if (*text == '#') {
+			while (*text && *text != '\n')
+				text++;
+			continue;
+		}
+
+		char key[32];
+		int value, n = 0;
+		if (sscanf(text, " %31[A-Za-z] = %d%n", key, &value, &n) == 2) {
+			if (strcmp(key, "threads") == 0) t.threads = value;
+			else if (strcmp(key, "stripWidth") == 0) t.stripWidth = value;
+			else if (strcmp(key, "softHalf") == 0) t.softHalf = value != 0;
+			else if (strcmp(key, "cpus") == 0) cpus = value;
+			else if (strcmp(key, "version") == 0) version = value;
+			text += n;
+		}
+		else {
+			// skip to the next pair
+			while (*text && *text != ',' && *text != '\n')
+				text++;
+			if (*text)
+				text++;
+		}
+	}
+}
+
+// This host's cache file, making its directory if need be; "" if there's
+// nowhere to put it.
+static std::string cachePath()
+{
+	std::string dir;
+	char host[256] = "";
+#ifdef _WIN32
+	const char *base = getenv("LOCALAPPDATA");
+	if (!base || !*base)
+		return "";
+	dir = std::string(base) + "\\Debander";
+	_mkdir(dir.c_str());
+	dir += "\\";
+	const char *name = getenv("COMPUTERNAME");
+	if (name)
+		strncpy(host, name, sizeof(host) - 1);
+#else
+	const char *xdg = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+	if (xdg && *xdg)
+		dir = xdg;
+	else if (home && *home)
+#  ifdef __APPLE__
+		dir = std::string(home) + "/Library/Caches";
+#  else
+		dir = std::string(home) + "/.cache";
+#  endif
+	else
+		return "";
+	mkdir(dir.c_str(), 0755);
+	dir += "/debander";
+	mkdir(dir.c_str(), 0755);
+	dir += "/";
+	gethostname(host, sizeof(host) - 1);
+#endif
+
+	// farm nodes often share a home directory, hence the host name
+	std::string file = "tuning-";
+	for (const char *c = host; *c; c++)
+		file += isalnum((unsigned char)*c) || *c == '-' || *c == '.' ? *c : '_';
+	if (!*host)
+		file += "unknown";
+	return dir + file + ".txt";
+}
+
+// the fastest of kRuns renders with the host's threads and strip width set to t
+static double timeSetting(KernelFn kernel, KernelArgs a, const Tuning &t, int cpus)
+{
+	// nothing to abort while tuning, and no instance to ask about it
+	DebandHost host = ofxDebandHost(0);
+	host.threads = t.threads > 0 ? t.threads : cpus;
+	host.stripWidth = t.stripWidth;
+	a.host = &host;
+
+	double best = 1e30;
+	for (int i = 0; i < kRuns; i++) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		kernel(a);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (seconds < best)
+			best = seconds;
+	}
+	return best;
+}
+
+// Time every setting on a synthetic float frame, the depth our farm
+// renders most, then F16C against software conversion on the same frame
+// in half, with the fastest of those settings.
+static Tuning calibrate(int cpus)
+{
+	const int w = kFrameWidth, h = kFrameHeight;
+
+	// 8-bit diagonal bands, with a noisy stripe across the middle so
+	// there's plain copying to do as well as ramps
+	std::vector<OfxRGBAColourF> src((size_t)w * h), dst((size_t)w * h);
+	unsigned int noise = 1;
+	for (int y = 0; y < h; y++)
+		for (int x = 0; x < w; x++) {
+			float v = std::floor((x + 2.f * y) * 96.f / (w + 2 * h));
+			if (y > h / 3 && y < 2 * h / 3) {
+				noise = noise * 1103515245 + 12345;
+				v += (noise >> 16) % 3;
+			}
+			OfxRGBAColourF p = { v / 255.f, v / 510.f, 1.f - v / 255.f, 1.f };
+			src[(size_t)y * w + x] = p;
+		}
+
+	// a grid and scratch kept across the runs, as an instance's are
+	OfxRectI rect = { 0, 0, w, h };
+	Quantization quant;
+	Scratch scratch;
+	KernelFn kernel = findKernel(32, 32, 4, kDirBoth, false, false, false);
+	KernelArgs a = { 0,
+		&src[0], rect, w * (int)sizeof(OfxRGBAColourF),
+		&dst[0], rect, w * (int)sizeof(OfxRGBAColourF),
+		0, rect, 0,
+		rect, kModeRamps, false, 0, 0, &quant, &scratch };
+
+	// all the threads, or one per core if they're hyperthreads
+	std::vector<int> threads(1, 0);
+	if (cpus >= 4)
+		threads.push_back(cpus / 2);
+
+	// the untuned settings first, which also warms the caches up
+	Tuning best;
+	double bestSeconds = timeSetting(kernel, a, best, cpus);
+	for (size_t i = 0; i < threads.size(); i++)
+		for (size_t j = 0; j < sizeof(kStripWidths) / sizeof(kStripWidths[0]); j++) {
+			Tuning t;
+			t.threads = threads[i];
+			t.stripWidth = kStripWidths[j];
+			if (!t.threads && !t.stripWidth)
+				continue;
+			double seconds = timeSetting(kernel, a, t, cpus);
+			if (seconds < bestSeconds * kMargin) {
+				best = t;
+				bestSeconds = seconds;
+			}
+		}
+
+	// without F16C there's nothing to choose
+	if (!halfHasF16C())
+		return best;
+
+	std::vector<OfxRGBAColourH> halfSrc((size_t)w * h), halfDst((size_t)w * h);
+	for (size_t i = 0; i < src.size(); i++) {
+		halfSrc[i].r = src[i].r;
+		halfSrc[i].g = src[i].g;
+		halfSrc[i].b = src[i].b;
+		halfSrc[i].a = src[i].a;
+	}
+	a.src = &halfSrc[0];
+	a.srcRowBytes = w * (int)sizeof(OfxRGBAColourH);
+	a.dst = &halfDst[0];
+	a.dstRowBytes = w * (int)sizeof(OfxRGBAColourH);
+	double f16c = timeSetting(findKernel(kBitDepthHalf, kBitDepthHalf, 4, kDirBoth, false, false, false), a, best, cpus);
+	double soft = timeSetting(findKernel(kBitDepthHalf, kBitDepthHalf, 4, kDirBoth, false, false, false, kSoftHalf), a, best, cpus);
+	best.softHalf = soft < f16c * kMargin;
+
+	return best;
+}
+
+// Time the settings and cache the fastest.
+static void tune()
+{
+	unsigned int nCPUs = 1;
+	g.pThreadSuite->multiThreadNumCPUs(&nCPUs);
+
+	Tuning best = calibrate((int)nCPUs);
+	g.tuning = best;
+
+	std::string path = cachePath();
+	if (!path.empty()) {
+		if (FILE *f = fopen(path.c_str(), "w")) {
+			fprintf(f, "# Debander tuning for this host; delete this file to tune again\n");
+			fprintf(f, "version=%d\ncpus=%u\nthreads=%d\nstripWidth=%d\nsoftHalf=%d\n",
+				kCacheVersion, nCPUs, best.threads, best.stripWidth, best.softHalf ? 1 : 0);
+			fclose(f);
+		}
+	}
+}
+
+void loadTuning()
+{
+	g.tuning = Tuning();
+	untuned = false;
+
+	int cpus = -1, version = 0;
+	const char *env = getenv(TUNING_ENV);
+	if (env) {
+		parseTuning(env, g.tuning, cpus, version);
+		return;
+	}
+
+	unsigned int nCPUs = 1;
+	g.pThreadSuite->multiThreadNumCPUs(&nCPUs);
+
+	// a cache file from a different CPU count is for some other machine
+	std::string path = cachePath();
+	if (!path.empty()) {
+		if (FILE *f = fopen(path.c_str(), "r")) {
+			char text[512];
+			size_t n = fread(text, 1, sizeof(text) - 1, f);
+			text[n] = 0;
+			fclose(f);
+
+			Tuning cached;
+			parseTuning(text, cached, cpus, version);
+			if (cpus == (int)nCPUs && version == kCacheVersion) {
+				g.tuning = cached;
+				return;
+			}
+		}
+	}
+
+	untuned = true;
+}
+
+void tuneOnce()
+{
+	if (untuned)
+		std::call_once(tuned, tune);
+}
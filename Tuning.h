@@ -0,0 +1,28 @@
+#pragma once
+
+#include "debander.h"
+
+
+////////////////////////////////////////////////////////////////////////////////
+// How many threads to use, how wide to cut column strips and whether
+// F16C beats software half conversion depends on the machine, so the
+// first render on each host times a few settings on synthetic frames and
+// keeps the fastest in a small file in the user's cache directory, named
+// for the host.  Later loads just read it back.  Tuning at the first
+// render rather than at load keeps host startup quick.
+//
+// DEBANDER_TUNING overrides all of that, e.g. "threads=8,stripWidth=512".
+// Anything it leaves out is 0, the untuned behaviour, and nothing is timed
+// or cached while it's set.  Delete the cache file to tune again.
+
+// name of the override variable
+#define TUNING_ENV "DEBANDER_TUNING"
+
+// Fill in g.tuning from the override or the cache file, if either has it.
+// Needs g's thread suite; call from onLoad.
+void loadTuning();
+
+// If loadTuning found nothing, time the settings and cache the fastest,
+// once; renders that come meanwhile wait for it.  Call at the start of
+// every render, before anything reads g.tuning.
+void tuneOnce();
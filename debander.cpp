@@ -3,13 +3,19 @@
 #include <stdexcept>
 #include <new>
 #include <cstring>
+#include <cstdio>
+#include <chrono>
+#include <atomic>
 #include "ofxMemory.h"
 #include "ofxMultiThread.h"
+#include "ofxMessage.h"
 #include "ofxUtilities.H" // example support utils
 
 #include "guicon.h"
-#include "ProcessRGBA.h"
-#include "ProcessAlpha.h"
+#include "KernelTable.h"
+#include "Tuning.h"
+#include "Metrics.h"
+#include "FrameBudget.h"
 
 
 #if defined __APPLE__ || defined linux || defined __FreeBSD__
@@ -24,11 +30,22 @@
 #define OFX_PLUGIN_GROUP "Uncle Bill's Pretty Good Software"
 #define OFX_PLUGIN_NAME  "Debander"
 
+// parameter names
+#define PARAM_MODE "mode"
+#define PARAM_DIRECTION "direction"
+#define PARAM_DITHER "dither"
+#define PARAM_KEEP_EDGES "keepEdges"
+#define PARAM_LUMA "lumaOnly"
+#define PARAM_PROXY_SCALE "proxyScale"
+#define PARAM_BUDGET "frameBudget"
+#define PARAM_DIAGNOSTIC "diagnostic"
+#define PARAM_OUTPUT_DEPTH "outputDepth"
+
 
 // ===================================================== //
 Globals g;
 
-// private instance data type
+// private instance data type; read-only while rendering
 struct MyInstanceData {
   bool isGeneralEffect;
 
@@ -36,6 +53,31 @@ struct MyInstanceData {
   OfxImageClipHandle sourceClip;
   OfxImageClipHandle maskClip;
   OfxImageClipHandle outputClip;
+
+  // handles to the parameters we read at render time
+  OfxParamHandle modeParam;
+  OfxParamHandle directionParam;
+  OfxParamHandle ditherParam;
+  OfxParamHandle keepEdgesParam;
+  OfxParamHandle lumaParam;
+  OfxParamHandle proxyScaleParam;
+  OfxParamHandle budgetParam;
+  OfxParamHandle diagnosticParam;
+  OfxParamHandle outputDepthParam;
+
+  // what rows and columns cost last frame, to split the next one evenly
+  CostProfile costProfile;
+
+  // the grid a float source sits on, kept from frame to frame
+  Quantization quant;
+
+  // what renders work in, kept so frames after the first few allocate nothing
+  ScratchPool scratchPool;
+
+  // what full frames cost against the frame budget, and whether the last
+  // one had to make do with rows
+  FrameBudget frameBudget;
+  std::atomic<bool> degraded;
 };
 
 /* mandatory function to set up the host structures */
@@ -58,6 +100,31 @@ getMyInstanceData( OfxImageEffectHandle effect)
 
 
 
+// ===================================================== //
+// the engine's hooks into the host
+
+static void hostParallel(DebandTask task, unsigned int threads, void *arg, void * /*user*/)
+{
+	g.pThreadSuite->multiThread(task, threads, arg);
+}
+
+static bool hostCancelled(void *effect)
+{
+	return g.pEffectSuite->abort((OfxImageEffectHandle)effect) != 0;
+}
+
+DebandHost ofxDebandHost(OfxImageEffectHandle effect)
+{
+	unsigned int nThreads = 1;
+	g.pThreadSuite->multiThreadNumCPUs(&nThreads);
+	if (g.tuning.threads > 0 && (unsigned int)g.tuning.threads < nThreads)
+		nThreads = g.tuning.threads;
+
+	DebandHost host = { hostParallel, nThreads, g.tuning.stripWidth, effect ? hostCancelled : 0, (void *)effect };
+	return host;
+}
+
+
 // ===================================================== //
 // MAIN ACTION FUNCTIONS
 
@@ -89,6 +156,11 @@ onLoad(void)
 	g.pPropSuite->propGetInt(g.pHost->host, kOfxImageEffectPropSupportsMultipleClipDepths, 0, &prop);
 	g.iHostSupportsMultipleBitDepths = (prop != 0);
 
+	// threads and strip width for this machine, if they've been timed;
+	// the first render times them otherwise
+	loadTuning();
+	startMetrics();
+
 	return kOfxStatOK;
 }
 
@@ -96,6 +168,7 @@ onLoad(void)
 static OfxStatus
 onUnLoad(void)
 {
+	stopMetrics();
 	return kOfxStatOK;
 }
 
@@ -121,6 +194,27 @@ describe(OfxImageEffectHandle  effect)
 	// say we can support multiple pixel depths and let the clip preferences action deal with it all.
 	g.pPropSuite->propSetInt(effectProps, kOfxImageEffectPropSupportsMultipleClipDepths, 0, 1);
 
+	// we read the render scale and cut corners at proxy resolutions
+	g.pPropSuite->propSetInt(effectProps, kOfxImageEffectPropSupportsMultiResolution, 0, 1);
+
+	// The host may render any number of frames of one instance at once.
+	// What those renders share, and how:
+	//  - g: written by setHost and onLoad, and g.tuning by the first
+	//    render, inside tuneOnce's call_once, before anything reads it.
+	//  - CostProfile: a mutex, held only to read or write the per-line
+	//    costs, never while a pass runs.
+	//  - Quantization: no lock; each render samples its own frame and only
+	//    the levels it finds are swapped in, atomically.
+	//  - ScratchPool: a mutex, held only to hand out or take back a Scratch; each
+	//    render then has its Scratch to itself until it gives it back.
+	//  - FrameBudget: a mutex, held only to read the guess before the
+	//    kernel runs and to store the timing after.
+	//  - metrics and the degraded flag: atomics.
+	// The rest of the instance data is only written at create/destroy.
+	// We thread within a frame ourselves.
+	g.pPropSuite->propSetString(effectProps, kOfxImageEffectPluginRenderThreadSafety, 0, kOfxImageEffectRenderFullySafe);
+	g.pPropSuite->propSetInt(effectProps, kOfxImageEffectPluginPropHostFrameThreading, 0, 0);
+
 	// disable tiling; we need the whole image
 	g.pPropSuite->propSetInt(effectProps, kOfxImageEffectPropSupportsTiles, 0, 0);
 
@@ -128,6 +222,10 @@ describe(OfxImageEffectHandle  effect)
 	g.pPropSuite->propSetString(effectProps, kOfxImageEffectPropSupportedPixelDepths, 0, kOfxBitDepthByte);
 	g.pPropSuite->propSetString(effectProps, kOfxImageEffectPropSupportedPixelDepths, 1, kOfxBitDepthShort);
 	g.pPropSuite->propSetString(effectProps, kOfxImageEffectPropSupportedPixelDepths, 2, kOfxBitDepthFloat);
+	g.pPropSuite->propSetString(effectProps, kOfxImageEffectPropSupportedPixelDepths, 3, kOfxBitDepthHalf);
+
+	// the output depth follows a parameter, so the host must ask again when it changes
+	g.pPropSuite->propSetString(effectProps, kOfxImageEffectPropClipPreferencesSlaveParam, 0, PARAM_OUTPUT_DEPTH);
 
 	return kOfxStatOK;
 }
@@ -147,14 +245,16 @@ describeInContext(OfxImageEffectHandle  effect, OfxPropertySetHandle inArgs)
 
 	// set the component types we can handle on out output
 	g.pPropSuite->propSetString(props, kOfxImageEffectPropSupportedComponents, 0, kOfxImageComponentRGBA);
-	g.pPropSuite->propSetString(props, kOfxImageEffectPropSupportedComponents, 1, kOfxImageComponentAlpha);
+	g.pPropSuite->propSetString(props, kOfxImageEffectPropSupportedComponents, 1, kOfxImageComponentRGB);
+	g.pPropSuite->propSetString(props, kOfxImageEffectPropSupportedComponents, 2, kOfxImageComponentAlpha);
 
 	// define the single source clip in both contexts
 	g.pEffectSuite->clipDefine(effect, kOfxImageEffectSimpleSourceClipName, &props);
 
 	// set the component types we can handle on our main input
 	g.pPropSuite->propSetString(props, kOfxImageEffectPropSupportedComponents, 0, kOfxImageComponentRGBA);
-	g.pPropSuite->propSetString(props, kOfxImageEffectPropSupportedComponents, 1, kOfxImageComponentAlpha);
+	g.pPropSuite->propSetString(props, kOfxImageEffectPropSupportedComponents, 1, kOfxImageComponentRGB);
+	g.pPropSuite->propSetString(props, kOfxImageEffectPropSupportedComponents, 2, kOfxImageComponentAlpha);
 
 	if (isGeneralContext) {
 		// define a second input that is a mask, alpha only and is optional
@@ -163,6 +263,119 @@ describeInContext(OfxImageEffectHandle  effect, OfxPropertySetHandle inArgs)
 		g.pPropSuite->propSetInt(props, kOfxImageClipPropOptional, 0, 1);
 	}
 
+	// get a pointer to the effect's parameter set
+	OfxParamSetHandle paramSet;
+	g.pEffectSuite->getParamSet(effect, &paramSet);
+
+	// how band pixels get interpolated
+	g.pParamSuite->paramDefine(paramSet, kOfxParamTypeChoice, PARAM_MODE, &props);
+	g.pPropSuite->propSetString(props, kOfxParamPropChoiceOption, kModeRamps, "Row/column ramps");
+	g.pPropSuite->propSetString(props, kOfxParamPropChoiceOption, kModeDistance, "Distance transform");
+	g.pPropSuite->propSetInt(props, kOfxParamPropDefault, 0, kModeRamps);
+	g.pPropSuite->propSetString(props, kOfxParamPropHint, 0,
+		"Row/column ramps interpolates each band along rows and columns separately. "
+		"Distance transform interpolates between a band's lower and upper contours "
+		"by 2-D distance, at the same cost per pixel however long the bands are.");
+	g.pPropSuite->propSetString(props, kOfxParamPropScriptName, 0, PARAM_MODE);
+	g.pPropSuite->propSetString(props, kOfxPropLabel, 0, "Mode");
+
+	// which ramps to run in ramps mode
+	g.pParamSuite->paramDefine(paramSet, kOfxParamTypeChoice, PARAM_DIRECTION, &props);
+	g.pPropSuite->propSetString(props, kOfxParamPropChoiceOption, kDirBoth, "Rows and columns");
+	g.pPropSuite->propSetString(props, kOfxParamPropChoiceOption, kDirRows, "Rows only");
+	g.pPropSuite->propSetString(props, kOfxParamPropChoiceOption, kDirColumns, "Columns only");
+	g.pPropSuite->propSetInt(props, kOfxParamPropDefault, 0, kDirBoth);
+	g.pPropSuite->propSetString(props, kOfxParamPropHint, 0,
+		"Which directions the row/column ramps run in. "
+		"One direction is about twice as fast, and leaves bands across it alone.");
+	g.pPropSuite->propSetString(props, kOfxParamPropScriptName, 0, PARAM_DIRECTION);
+	g.pPropSuite->propSetString(props, kOfxPropLabel, 0, "Direction");
+
+	// ordered dither when rounding back to 8 or 16 bits
+	g.pParamSuite->paramDefine(paramSet, kOfxParamTypeBoolean, PARAM_DITHER, &props);
+	g.pPropSuite->propSetInt(props, kOfxParamPropDefault, 0, 1);
+	g.pPropSuite->propSetString(props, kOfxParamPropHint, 0,
+		"Dither the smoothed ramps when writing 8 or 16 bit images, so they don't "
+		"round straight back into bands. Float and half images are never dithered.");
+	g.pPropSuite->propSetString(props, kOfxParamPropScriptName, 0, PARAM_DITHER);
+	g.pPropSuite->propSetString(props, kOfxPropLabel, 0, "Dither");
+
+	// limit band ends to half a step, rather than halfway to their neighbours
+	g.pParamSuite->paramDefine(paramSet, kOfxParamTypeBoolean, PARAM_KEEP_EDGES, &props);
+	g.pPropSuite->propSetInt(props, kOfxParamPropDefault, 0, 0);
+	g.pPropSuite->propSetString(props, kOfxParamPropHint, 0,
+		"Move the ends of each band at most half a quantization step towards the pixels beside it, "
+		"so only banding is smoothed and real edges next to a band stay sharp. "
+		"Float images need values on an evenly spaced grid of at most 65535 steps, such as 8, 10 or 16 bit video; half images are never limited.");
+	g.pPropSuite->propSetString(props, kOfxParamPropScriptName, 0, PARAM_KEEP_EDGES);
+	g.pPropSuite->propSetString(props, kOfxPropLabel, 0, "Keep Edges");
+
+	// deband Y and leave chroma alone
+	g.pParamSuite->paramDefine(paramSet, kOfxParamTypeBoolean, PARAM_LUMA, &props);
+	g.pPropSuite->propSetInt(props, kOfxParamPropDefault, 0, 0);
+	g.pPropSuite->propSetString(props, kOfxParamPropHint, 0,
+		"Deband only brightness (Rec. 709 luma) and pass colour through untouched. "
+		"Banding in 8-bit video is mostly in luma, and this does a quarter of the band work. "
+		"Alpha-only images ignore it.");
+	g.pPropSuite->propSetString(props, kOfxParamPropScriptName, 0, PARAM_LUMA);
+	g.pPropSuite->propSetString(props, kOfxPropLabel, 0, "Luma Only");
+
+	// render scale below which we switch to the fast preview kernel
+	g.pParamSuite->paramDefine(paramSet, kOfxParamTypeDouble, PARAM_PROXY_SCALE, &props);
+	g.pPropSuite->propSetDouble(props, kOfxParamPropDefault, 0, 0.75);
+	g.pPropSuite->propSetDouble(props, kOfxParamPropMin, 0, 0.0);
+	g.pPropSuite->propSetDouble(props, kOfxParamPropMax, 0, 1.0);
+	g.pPropSuite->propSetDouble(props, kOfxParamPropDisplayMin, 0, 0.0);
+	g.pPropSuite->propSetDouble(props, kOfxParamPropDisplayMax, 0, 1.0);
+	g.pPropSuite->propSetString(props, kOfxParamPropHint, 0,
+		"When the host renders at a proxy scale below this, only the row ramps are run, "
+		"whatever Mode and Direction say, to keep viewer playback interactive. "
+		"Full-scale renders are never affected. 0 turns this off.");
+	g.pPropSuite->propSetString(props, kOfxParamPropScriptName, 0, PARAM_PROXY_SCALE);
+	g.pPropSuite->propSetString(props, kOfxPropLabel, 0, "Fast Below Scale");
+
+	// time a frame may take before we fall back to the row ramps
+	g.pParamSuite->paramDefine(paramSet, kOfxParamTypeDouble, PARAM_BUDGET, &props);
+	g.pPropSuite->propSetDouble(props, kOfxParamPropDefault, 0, 0.0);
+	g.pPropSuite->propSetDouble(props, kOfxParamPropMin, 0, 0.0);
+	g.pPropSuite->propSetDouble(props, kOfxParamPropDisplayMin, 0, 0.0);
+	g.pPropSuite->propSetDouble(props, kOfxParamPropDisplayMax, 0, 100.0);
+	g.pPropSuite->propSetString(props, kOfxParamPropHint, 0,
+		"Milliseconds each frame may take, for live playback. When the frames before say a frame won't make it, "
+		"it gets only the row ramps, and is noted in the host's log. 0 turns this off.");
+	g.pPropSuite->propSetString(props, kOfxParamPropScriptName, 0, PARAM_BUDGET);
+	g.pPropSuite->propSetString(props, kOfxPropLabel, 0, "Frame Budget (ms)");
+
+	// show how the frame was debanded instead of the result
+	g.pParamSuite->paramDefine(paramSet, kOfxParamTypeChoice, PARAM_DIAGNOSTIC, &props);
+	g.pPropSuite->propSetString(props, kOfxParamPropChoiceOption, kDiagOff, "Off");
+	g.pPropSuite->propSetString(props, kOfxParamPropChoiceOption, kDiagBandLength, "Band length");
+	g.pPropSuite->propSetString(props, kOfxParamPropChoiceOption, kDiagCost, "Processing cost");
+	g.pPropSuite->propSetString(props, kOfxParamPropChoiceOption, kDiagCopied, "Copied / interpolated");
+	g.pPropSuite->propSetInt(props, kOfxParamPropDefault, 0, kDiagOff);
+	g.pPropSuite->propSetString(props, kOfxParamPropHint, 0,
+		"Replace the output with a view of the debanding: the length of each pixel's longest band "
+		"(log scale, white is the frame size), the time spent per pixel by the thread that rendered it "
+		"(blue cheap, red expensive; with the row and column ramps both on, their single pass is timed "
+		"per chunk of columns, so this shows vertical stripes), or green where pixels were interpolated over the dimmed source. "
+		"A per-frame summary of band counts and pass times also goes to the host's log.");
+	g.pPropSuite->propSetString(props, kOfxParamPropScriptName, 0, PARAM_DIAGNOSTIC);
+	g.pPropSuite->propSetString(props, kOfxPropLabel, 0, "Diagnostic");
+
+	// write the smoothed ramps at a deeper depth than the source's
+	g.pParamSuite->paramDefine(paramSet, kOfxParamTypeChoice, PARAM_OUTPUT_DEPTH, &props);
+	g.pPropSuite->propSetString(props, kOfxParamPropChoiceOption, kOutputSameDepth, "Same as source");
+	g.pPropSuite->propSetString(props, kOfxParamPropChoiceOption, kOutput16Bit, "16 bit");
+	g.pPropSuite->propSetString(props, kOfxParamPropChoiceOption, kOutputFloat, "Float");
+	g.pPropSuite->propSetInt(props, kOfxParamPropDefault, 0, kOutputSameDepth);
+	g.pPropSuite->propSetString(props, kOfxParamPropHint, 0,
+		"Render 8 bit sources to 16 bit or float, or 16 bit sources to float, so the ramps keep "
+		"the in-between values that rounding to the source's depth would lose. "
+		"Half, float and deeper sources stay as they are, as does everything on hosts "
+		"that can't mix clip depths.");
+	g.pPropSuite->propSetString(props, kOfxParamPropScriptName, 0, PARAM_OUTPUT_DEPTH);
+	g.pPropSuite->propSetString(props, kOfxPropLabel, 0, "Output Depth");
+
 	return kOfxStatOK;
 }
 
@@ -195,6 +408,18 @@ createInstance(OfxImageEffectHandle effect)
 	}
 	else
 		myData->maskClip = 0;
+	myData->degraded = false;
+
+	// cache away our param handles
+	g.pParamSuite->paramGetHandle(paramSet, PARAM_MODE, &myData->modeParam, 0);
+	g.pParamSuite->paramGetHandle(paramSet, PARAM_DIRECTION, &myData->directionParam, 0);
+	g.pParamSuite->paramGetHandle(paramSet, PARAM_DITHER, &myData->ditherParam, 0);
+	g.pParamSuite->paramGetHandle(paramSet, PARAM_KEEP_EDGES, &myData->keepEdgesParam, 0);
+	g.pParamSuite->paramGetHandle(paramSet, PARAM_LUMA, &myData->lumaParam, 0);
+	g.pParamSuite->paramGetHandle(paramSet, PARAM_PROXY_SCALE, &myData->proxyScaleParam, 0);
+	g.pParamSuite->paramGetHandle(paramSet, PARAM_BUDGET, &myData->budgetParam, 0);
+	g.pParamSuite->paramGetHandle(paramSet, PARAM_DIAGNOSTIC, &myData->diagnosticParam, 0);
+	g.pParamSuite->paramGetHandle(paramSet, PARAM_OUTPUT_DEPTH, &myData->outputDepthParam, 0);
 
 	// set my private instance data
 	g.pPropSuite->propSetPointer(effectProps, kOfxPropInstanceData, 0, (void *)myData);
@@ -232,6 +457,38 @@ isIdentity(OfxImageEffectHandle  effect,
 	return kOfxStatReplyDefault;
 }
 
+// one line per frame in the host's log, for diagnostic renders
+static void
+logFrameStats(OfxImageEffectHandle handle, OfxTime time, OfxRectI window, const KernelStats &stats)
+{
+	if (!g.pMessageSuite)
+		return;
+
+	char line[512];
+	int n = snprintf(line, sizeof(line), "Debander frame %g, %dx%d: %lld row bands, %lld column bands; lengths",
+		time, window.x2 - window.x1, window.y2 - window.y1, stats.rowBands, stats.columnBands);
+	for (int i = 0, top = 2; i < kLengthBuckets && n < (int)sizeof(line); i++, top *= 2) {
+		if (i < kLengthBuckets - 1)
+			n += snprintf(line + n, sizeof(line) - n, " <=%d:%lld", top, stats.lengths[i]);
+		else
+			n += snprintf(line + n, sizeof(line) - n, " more:%lld", stats.lengths[i]);
+	}
+	for (size_t i = 0; i < stats.passSeconds.size() && n < (int)sizeof(line); i++)
+		n += snprintf(line + n, sizeof(line) - n, "%s%.1f", i ? " + " : "; passes ", stats.passSeconds[i] * 1000.);
+	if (n < (int)sizeof(line))
+		snprintf(line + n, sizeof(line) - n, " ms");
+
+	g.pMessageSuite->message(handle, kOfxMessageLog, 0, "%s", line);
+}
+
+// bytes in one pixel of an ofxuGetImage depth, for the metrics
+static int
+pixelBytes(int bitDepth, int components)
+{
+	int channelBytes = bitDepth == 8 ? 1 : bitDepth == 32 ? 4 : 2;
+	return components * channelBytes;
+}
+
 // the process code  that the host sees
 static OfxStatus render(OfxImageEffectHandle  handle,
 	OfxPropertySetHandle inArgs,
@@ -242,126 +499,128 @@ static OfxStatus render(OfxImageEffectHandle  handle,
 	OfxRectI renderWindow;
 	OfxStatus status = kOfxStatOK;
 
+	// the first render on a new host times the settings before going on
+	tuneOnce();
+	int variants = g.tuning.softHalf ? kSoftHalf : 0;
+
 	g.pPropSuite->propGetDouble(inArgs, kOfxPropTime, 0, &time);
 	g.pPropSuite->propGetIntN(inArgs, kOfxImageEffectPropRenderWindow, 4, &renderWindow.x1);
 
 	// retrieve any instance data associated with this effect
 	MyInstanceData *myData = getMyInstanceData(handle);
 
+	// fetch the param values at this time
+	int mode = kModeRamps;
+	g.pParamSuite->paramGetValueAtTime(myData->modeParam, time, &mode);
+	int direction = kDirBoth;
+	g.pParamSuite->paramGetValueAtTime(myData->directionParam, time, &direction);
+	int dither = 1;
+	g.pParamSuite->paramGetValueAtTime(myData->ditherParam, time, &dither);
+	int keepEdges = 0;
+	g.pParamSuite->paramGetValueAtTime(myData->keepEdgesParam, time, &keepEdges);
+	int luma = 0;
+	g.pParamSuite->paramGetValueAtTime(myData->lumaParam, time, &luma);
+	double proxyScale = 0;
+	g.pParamSuite->paramGetValueAtTime(myData->proxyScaleParam, time, &proxyScale);
+	double budget = 0;
+	g.pParamSuite->paramGetValueAtTime(myData->budgetParam, time, &budget);
+	int diagnostic = kDiagOff;
+	g.pParamSuite->paramGetValueAtTime(myData->diagnosticParam, time, &diagnostic);
+
+	// At proxy scale the host has already shrunk the bands along with the
+	// image, so the ramps still fit them; we just do less work per frame.
+	// Nothing needs scaling to match: bands are whatever runs of equal
+	// pixels the shrunk image has, however long, and the half-step limit
+	// is in codes, which shrinking doesn't change.  So render scale only
+	// picks the kernel, and the row ramps are the cheapest there is: one
+	// pass, each row on its own.
+	OfxPointD renderScale = { 1, 1 };
+	g.pPropSuite->propGetDoubleN(inArgs, kOfxImageEffectPropRenderScale, 2, &renderScale.x);
+	if (renderScale.x < proxyScale || renderScale.y < proxyScale) {
+		mode = kModeRamps;
+		direction = kDirRows;
+	}
+
 	// property handles and members of each image
 	// in reality, we would put this in a struct as the C++ support layer does
 	OfxPropertySetHandle sourceImg = NULL, outputImg = NULL, maskImg = NULL;
 	int srcRowBytes, srcBitDepth, dstRowBytes, dstBitDepth, maskRowBytes = 0, maskBitDepth;
-	bool srcIsAlpha, dstIsAlpha, maskIsAlpha = false;
+	int srcComponents, dstComponents, maskComponents = 0;
 	OfxRectI dstRect, srcRect, maskRect = { 0 };
 	void *src, *dst, *mask = NULL;
+	Scratch *scratch = myData->scratchPool.take();
 
 	try {
 		// get the source image
-		sourceImg = ofxuGetImage(myData->sourceClip, time, srcRowBytes, srcBitDepth, srcIsAlpha, srcRect, src);
+		sourceImg = ofxuGetImage(myData->sourceClip, time, srcRowBytes, srcBitDepth, srcComponents, srcRect, src);
 		if (sourceImg == NULL) throw OfxuNoImageException();
 
 		// get the output image
-		outputImg = ofxuGetImage(myData->outputClip, time, dstRowBytes, dstBitDepth, dstIsAlpha, dstRect, dst);
+		outputImg = ofxuGetImage(myData->outputClip, time, dstRowBytes, dstBitDepth, dstComponents, dstRect, dst);
 		if (outputImg == NULL) throw OfxuNoImageException();
 
 		if (myData->isGeneralEffect) {
 			// is the mask connected?
 			if (ofxuIsClipConnected(handle, "Mask")) {
-				maskImg = ofxuGetImage(myData->maskClip, time, maskRowBytes, maskBitDepth, maskIsAlpha, maskRect, mask);
+				maskImg = ofxuGetImage(myData->maskClip, time, maskRowBytes, maskBitDepth, maskComponents, maskRect, mask);
 
 				if (maskImg != NULL) {
 					// and see that it is a single component
-					if (!maskIsAlpha || maskBitDepth != srcBitDepth) {
+					if (maskComponents != 1 || maskBitDepth != srcBitDepth) {
 						throw OfxuStatusException(kOfxStatErrImageFormat);
 					}
 				}
 			}
 		}
 
-		// see if they have the same depths and bytes and all
-		if (srcBitDepth != dstBitDepth || srcIsAlpha != dstIsAlpha) {
+		// see if they have the same components; findKernel only knows the
+		// depth pairs we can promote between
+		if (srcComponents != dstComponents) {
 			throw OfxuStatusException(kOfxStatErrImageFormat);
 		}
 
 		// do the rendering
-		if (!dstIsAlpha) {
-			switch (dstBitDepth) {
-#if 0
-// int types not supported by debander
-			case 8: {
-				ProcessRGBA<OfxRGBAColourB, unsigned char, 255, 0> fred(handle,
-					src, srcRect, srcRowBytes,
-					dst, dstRect, dstRowBytes,
-					mask, maskRect, maskRowBytes,
-					renderWindow);
-				fred.process(g.pThreadSuite);
-				break;
-			}
-
-			case 16: {
-				ProcessRGBA<OfxRGBAColourS, unsigned short, 65535, 0> fred(handle,
-					src, srcRect, srcRowBytes,
-					dst, dstRect, dstRowBytes,
-					mask, maskRect, maskRowBytes,
-					renderWindow);
-				fred.process(g.pThreadSuite);
-				break;
-			}
-#endif
-
-			case 32: {
-				ProcessRGBA<OfxRGBAColourF, float, 1, 1> fred(handle,
-					src, srcRect, srcRowBytes,
-					dst, dstRect, dstRowBytes,
-					mask, maskRect, maskRowBytes,
-					renderWindow);
-				fred.process(g.pThreadSuite);
-				break;
-			}
+		KernelFn kernel = findKernel(srcBitDepth, dstBitDepth, dstComponents, direction, mask != NULL, dither != 0, luma != 0, variants);
+		if (!kernel)
+			throw OfxuStatusException(kOfxStatErrImageFormat);
 
-			default:
-				throw OfxuStatusException(kOfxStatErrImageFormat);
-			}
+		KernelStats stats;
+		DebandHost host = ofxDebandHost(handle);
+		KernelArgs args = { &host,
+			src, srcRect, srcRowBytes,
+			dst, dstRect, dstRowBytes,
+			mask, maskRect, maskRowBytes,
+			renderWindow, mode, keepEdges != 0,
+			diagnostic != kDiagOff ? &stats : 0,
+			&myData->costProfile, &myData->quant, scratch };
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		// Under a budget, anything more than the row ramps may get cut
+		// back to them.  Log every frame that is, and when it stops.
+		if (budget > 0 && !(mode == kModeRamps && direction == kDirRows)) {
+			KernelFn rows = findKernel(srcBitDepth, dstBitDepth, dstComponents, kDirRows, mask != NULL, dither != 0, luma != 0, variants);
+			bool degraded = myData->frameBudget.render(kernel, rows, args, budget / 1000.);
+			bool was = myData->degraded.exchange(degraded);
+			if (g.pMessageSuite && degraded)
+				g.pMessageSuite->message(handle, kOfxMessageLog, 0,
+					"Debander frame %g: over the %g ms budget, rendered rows only", time, budget);
+			else if (g.pMessageSuite && was)
+				g.pMessageSuite->message(handle, kOfxMessageLog, 0,
+					"Debander frame %g: back within the %g ms budget, rendering in full", time, budget);
 		}
-		else {
-			switch (dstBitDepth) {
-#if 0
-// int types not supported by debander
-			case 8: {
-				ProcessAlpha<unsigned char, unsigned char, 255, 0> fred(handle,
-					src, srcRect, srcRowBytes,
-					dst, dstRect, dstRowBytes,
-					mask, maskRect, maskRowBytes,
-					renderWindow);
-				fred.process(g.pThreadSuite);
-				break;
-			}
-
-			case 16: {
-				ProcessAlpha<unsigned short, unsigned short, 65535, 0> fred(handle,
-					src, srcRect, srcRowBytes,
-					dst, dstRect, dstRowBytes,
-					mask, maskRect, maskRowBytes,
-					renderWindow);
-				fred.process(g.pThreadSuite);
-				break;
-			}
-#endif
+		else
+			kernel(args);
 
-			case 32: {
-				ProcessAlpha<float, float, 1, 1> fred(handle,
-					src, srcRect, srcRowBytes,
-					dst, dstRect, dstRowBytes,
-					mask, maskRect, maskRowBytes,
-					renderWindow);
-				fred.process(g.pThreadSuite);
-				break;
-			}
-			default:
-				throw OfxuStatusException(kOfxStatErrImageFormat);
-			}
+		if (diagnostic != kDiagOff && !g.pEffectSuite->abort(handle)) {
+			findDiagnostic(srcBitDepth, dstBitDepth, dstComponents, variants)(args, diagnostic, stats);
+			logFrameStats(handle, time, renderWindow, stats);
 		}
+
+		long long pixels = (long long)(renderWindow.x2 - renderWindow.x1) * (renderWindow.y2 - renderWindow.y1);
+		count(metrics.renderMicroseconds, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+		count(metrics.pixels, pixels);
+		count(metrics.bytesRead, pixels * (pixelBytes(srcBitDepth, srcComponents) + (mask ? pixelBytes(maskBitDepth, 1) : 0)));
+		count(metrics.bytesWritten, pixels * pixelBytes(dstBitDepth, dstComponents));
 	}
 	catch (OfxuNoImageException &ex) {
 		// if we were interrupted, the failed fetch is fine, just return kOfxStatOK
@@ -374,6 +633,14 @@ static OfxStatus render(OfxImageEffectHandle  handle,
 		status = ex.status();
 	}
 
+	myData->scratchPool.give(scratch);
+
+	count(metrics.renders);
+	if (g.pEffectSuite->abort(handle))
+		count(metrics.aborts);
+	else if (status != kOfxStatOK)
+		count(metrics.failures);
+
 	// release the data pointers
 	if (maskImg)
 		g.pEffectSuite->clipReleaseImage(maskImg);
@@ -456,18 +723,30 @@ getClipPreferences(OfxImageEffectHandle  effect, OfxPropertySetHandle /*inArgs*/
 	MyInstanceData *myData = getMyInstanceData(effect);
 
 	// get the component type and bit depth of our main input
-	int  bitDepth;
-	bool isRGBA;
-	ofxuClipGetFormat(myData->sourceClip, bitDepth, isRGBA, true); // get the unmapped clip component
+	int  bitDepth = ofxuGetClipPixelDepth(myData->sourceClip, true);
+	int  components = ofxuGetClipComponentCount(myData->sourceClip, true); // get the unmapped clip component
+
+	// the output may be deeper, if asked for and it's a promotion we have kernels for
+	int outputDepth = kOutputSameDepth;
+	g.pParamSuite->paramGetValue(myData->outputDepthParam, &outputDepth);
+	int dstBitDepth = bitDepth;
+	if (outputDepth == kOutput16Bit && bitDepth == 8)
+		dstBitDepth = 16;
+	else if (outputDepth == kOutputFloat && (bitDepth == 8 || bitDepth == 16))
+		dstBitDepth = 32;
 
 																   // get the strings used to label the various bit depths
-	const char *bitDepthStr = bitDepth == 8 ? kOfxBitDepthByte : (bitDepth == 16 ? kOfxBitDepthShort : kOfxBitDepthFloat);
-	const char *componentStr = isRGBA ? kOfxImageComponentRGBA : kOfxImageComponentAlpha;
-
-	// set out output to be the same same as the input, component and bitdepth
+	const char *bitDepthStr = bitDepth == 8 ? kOfxBitDepthByte : (bitDepth == 16 ? kOfxBitDepthShort :
+		(bitDepth == kOfxuBitDepthHalf ? kOfxBitDepthHalf : kOfxBitDepthFloat));
+	const char *dstBitDepthStr = dstBitDepth == 8 ? kOfxBitDepthByte : (dstBitDepth == 16 ? kOfxBitDepthShort :
+		(dstBitDepth == kOfxuBitDepthHalf ? kOfxBitDepthHalf : kOfxBitDepthFloat));
+	const char *componentStr = components == 1 ? kOfxImageComponentAlpha :
+		(components == 3 ? kOfxImageComponentRGB : kOfxImageComponentRGBA);
+
+	// set out output to have the input's components, and its bitdepth or the deeper one
 	g.pPropSuite->propSetString(outArgs, "OfxImageClipPropComponents_Output", 0, componentStr);
 	if (g.iHostSupportsMultipleBitDepths)
-		g.pPropSuite->propSetString(outArgs, "OfxImageClipPropDepth_Output", 0, bitDepthStr);
+		g.pPropSuite->propSetString(outArgs, "OfxImageClipPropDepth_Output", 0, dstBitDepthStr);
 
 	// if a general effect, we may have a mask input, check that for types
 	if (myData->isGeneralEffect) {
@@ -2,7 +2,25 @@
 
 #include "ofxCore.h"
 #include "ofxImageEffect.h"
+#include "DebandCore.h"
 
+// what depth the output clip asks for, given an 8 or 16 bit source
+enum OutputDepth {
+	kOutputSameDepth = 0,
+	kOutput16Bit = 1,		// 8 bit sources only
+	kOutputFloat = 2
+};
+
+// what the tuner picked for this machine (Tuning.h)
+struct Tuning {
+	int threads = 0;		// most threads a pass uses; 0 is as many as the host offers
+	int stripWidth = 0;		// widest chunk of a column pass; 0 is no limit
+	bool softHalf = false;	// half kernels convert in software, even with F16C
+};
+
+// Set up by setHost and onLoad, then only read -- renders run concurrently.
+// The one exception is tuning, which the first render may fill in before
+// any render reads it (see tuneOnce).
 struct Globals {
 	// Host main pointer
 	OfxHost					*pHost = NULL;
@@ -18,5 +36,12 @@ struct Globals {
 
 	// some flags about the host's behaviour
 	bool iHostSupportsMultipleBitDepths = false;
+
+	Tuning tuning;
 };
 extern Globals g;
+
+// The engine's view of the host for a render of effect: the thread suite,
+// the tuned thread count and strip width, and abort.  effect may be 0,
+// for renders nothing can abort.
+DebandHost ofxDebandHost(OfxImageEffectHandle effect);